@@ -4,19 +4,52 @@
  * Convert a HGT (.hgt) raster to a subset of PNG (.png) rasters
  * 
  */
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <cinttypes>
+#include <cerrno>
 #include <cmath>
+#include <condition_variable>
+#include <cstdarg>
 #include <cstdint>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <ctime>
 #include <cctype>
+#include <deque>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <set>
 #include <string>
+#include <thread>
+#include <tuple>
+#include <type_traits>
 #include <vector>
 
 #include <libpng/png.h>
 
+#if defined(_MSC_VER)
+    #include <direct.h>
+    #include <sys/stat.h>
+    #include <sys/utime.h>
+#else
+    #include <dirent.h>
+    #include <fcntl.h>
+    #include <glob.h>
+    #include <signal.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+    #include <utime.h>
+#endif
+
 /*
  * Cross platform 64-bit file support
  */
@@ -45,30 +78,4129 @@ bool is_little_endian() {
 }
 
 /*
- * Degrees To Radians
+ * Degrees To Radians
+ */
+double deg_to_rad(const double deg) {
+    return deg * 3.14159265358979323846 / 180;
+}
+
+/*
+ * libpng 'write' function
+ * 
+ * Write a png to a std::vector of bytes
+ */
+void libpng_write_stdvector(png_structp png_ptr, png_bytep data, png_size_t length) {
+    std::vector<std::uint8_t>* png = reinterpret_cast<std::vector<std::uint8_t>*>(png_get_io_ptr(png_ptr));
+    png->insert(png->end(), data, data + length);
+}
+
+/*
+ * Sample conversions
+ *
+ * Map a signed HGT sample to the unsigned 16 bit PNG encoding,
+ * voids (-32768) always encode to 0xFFFF
+ */
+std::uint16_t to_absolute(const std::int16_t value) {
+    return value == -32768 ? 0xFFFF : static_cast<std::uint16_t>(static_cast<double>(value) + 32767.0);
+}
+
+std::uint16_t to_relative(const std::int16_t value, const double minf, const double deltaf) {
+    if (value == -32768) return 0xFFFF;
+    if (deltaf <= 0.0 || value <= minf) return 0;
+    if (value >= minf + deltaf) return 65534;
+    return static_cast<std::uint16_t>((static_cast<double>(value) - minf) * 65534.0 / deltaf);
+}
+
+/*
+ * Subtile
+ *
+ * Offsets of the top left pixel, the encoded size and the range of raw samples (voids included),
+ * gathered during the range pass. A subtile whose minimum equals its maximum is constant.
+ * Padded edge subtiles extend past the raster, their range includes the void padding.
+ * The roughness, the sum of the absolute differences along its rows, predicts its encode cost.
+ * Offsets of overview subtiles are in the pixels of their level, their range is not scanned.
+ * 'scheme' indexes the tiling scheme of the run's options the subtile belongs to.
+ */
+struct Subtile {
+    int level;
+    int scheme;
+    int row_offset;
+    int col_offset;
+    int width;
+    int height;
+    std::int16_t minimum;
+    std::int16_t maximum;
+    std::uint64_t source_hash;
+    std::uint64_t roughness;
+};
+
+/*
+ * PNG Calibration
+ *
+ * The 'sCAL' pixel dimensions and the 'pCAL' parameters shared by every subtile
+ */
+struct PngCalibration {
+    double upx;
+    double upy;
+    double minf;
+    double deltaf;
+};
+
+/*
+ * PNG Format
+ *
+ * The channels and bit depth of the encoded pixels. Formats with a 'pCAL' description
+ * map their samples to physical values, the others only carry the 'sCAL' dimensions.
+ */
+struct PngFormat {
+    int channels;
+    int depth;
+    const char* description;
+    const char* units;
+
+    int pixel_size() const { return channels * depth / 8; }
+};
+
+const PngFormat elevation_format = { 1, 16, "SRTM-HGT", "m" };
+
+/*
+ * Encode a grayscale, RGB or RGBA PNG
+ *
+ * Each of the 'height' row pointers references 'width' pixels of native endian samples
+ */
+void encode_png(std::vector<std::uint8_t>& png_data, const int width, const int height,
+                const PngCalibration& cal, std::uint8_t** png_rows, const PngFormat& format = elevation_format)
+{
+    /*
+     * Setup the PNG info
+     */
+    png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    png_infop   info = png_create_info_struct(png);
+    png_set_IHDR(png, info,
+        static_cast<png_uint_32>(width),
+        static_cast<png_uint_32>(height),
+        format.depth,
+        format.channels == 4 ? PNG_COLOR_TYPE_RGB_ALPHA : format.channels == 3 ? PNG_COLOR_TYPE_RGB : PNG_COLOR_TYPE_GRAY,
+        PNG_INTERLACE_NONE,
+        PNG_COMPRESSION_TYPE_DEFAULT,
+        PNG_FILTER_TYPE_DEFAULT
+    );
+
+    /*
+     * Set the 'sCAL' (Physical Scale)
+     * 
+     * The dimensions of each pixel in radians
+     */
+    png_set_sCAL(png, info, 2, cal.upx, cal.upy);
+
+    /*
+     * Set the 'pCAL' (Pixel Calibration)
+     * 
+     * The 1st order function mapping the encoded PNG values to the physical values
+     */
+    if (format.description)
+    {
+        auto decription = std::string(format.description);
+        auto units = std::string(format.units);
+        auto p0 = std::to_string(cal.minf);
+        auto p1 = std::to_string(cal.deltaf);
+        png_charp params[2] = { &p0.at(0), &p1.at(0)};
+        png_set_pCAL(png, info, &decription.at(0), -32767, 32767, 0, 2, &units.at(0), params);
+    }
+
+    /*
+     * Write the PNG to a buffer
+     */
+    png_set_rows(png, info, png_rows);
+    png_set_write_fn(png, &png_data, libpng_write_stdvector, NULL);
+    png_write_png(png, info, format.depth == 16 && is_little_endian() ? PNG_TRANSFORM_SWAP_ENDIAN : PNG_TRANSFORM_IDENTITY, NULL);
+    png_destroy_write_struct(&png, &info);
+}
+
+/*
+ * Constant Subtile Cache
+ *
+ * A subtile holding a single value encodes to the same PNG regardless of where
+ * it lies, so it is encoded once per (width, height, format, pixel, sCAL/pCAL) and reused
+ */
+class ConstantCache {
+public:
+    const std::vector<std::uint8_t>& get(const int width, const int height,
+                                         const std::uint16_t value, const PngCalibration& cal)
+    {
+        return get(width, height, reinterpret_cast<const std::uint8_t*>(&value), cal, elevation_format);
+    }
+
+    const std::vector<std::uint8_t>& get(const int width, const int height, const std::uint8_t* pixel,
+                                         const PngCalibration& cal, const PngFormat& format)
+    {
+        const auto pixel_size = static_cast<std::size_t>(format.pixel_size());
+        std::uint64_t value = 0;
+        std::memcpy(&value, pixel, pixel_size);
+        const auto key = std::make_tuple(width, height, format.channels, format.depth, format.description,
+                                         value, cal.upx, cal.upy, cal.minf, cal.deltaf);
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            auto found = cache.find(key);
+            if (found != cache.end()) return found->second;
+        }
+
+        /*
+         * Every row references the same row of the pixel
+         */
+        std::vector<std::uint8_t> row(pixel_size * width);
+        for (std::size_t x = 0; x < row.size(); x += pixel_size) std::memcpy(&row[x], pixel, pixel_size);
+        std::vector<std::uint8_t*> png_rows(height, row.data());
+        std::vector<std::uint8_t> png_data;
+        encode_png(png_data, width, height, cal, png_rows.data(), format);
+
+        std::lock_guard<std::mutex> guard(lock);
+        return cache.emplace(key, std::move(png_data)).first->second;
+    }
+
+private:
+    std::map<std::tuple<int, int, int, int, const char*, std::uint64_t, double, double, double, double>,
+             std::vector<std::uint8_t>> cache;
+    std::mutex lock;
+};
+
+/*
+ * Reduce a 16 bit raster by 2x for the next overview level
+ *
+ * Output sample (i, j) averages the 3x3 neighbourhood of input sample (2i, 2j)
+ * with [1 2 1] weights along each axis, so the corner samples shared by adjacent
+ * subtiles stay aligned. Voids (0xFFFF) carry no weight, a neighbourhood of voids stays void.
+ *
+ * The weights are selected rather than branched on, and the edge columns are filtered
+ * apart from the interior, so the row loops are left to the compiler's vectorizer.
+ * The rounded division goes through float, exact as a quotient of at most 16 weights
+ * lies at least 1/16 from the next integer.
+ */
+void reduce_raster(const std::uint16_t* in, const int width, const int height, std::uint16_t* out) {
+    const int out_width = (width - 1) / 2 + 1;
+    const int out_height = (height - 1) / 2 + 1;
+
+    /*
+     * Horizontally filtered sums and weights of the input rows above,
+     * at and below the current output row
+     */
+    std::vector<std::uint32_t> sums[3];
+    std::vector<std::uint32_t> weights[3];
+    for (auto k = 0; k < 3; k++)
+    {
+        sums[k].resize(out_width);
+        weights[k].resize(out_width);
+    }
+    auto filter_row = [&](const int y, std::uint32_t* sum, std::uint32_t* weight) {
+        const std::uint16_t* row = in + static_cast<std::size_t>(y) * width;
+        const auto filter = [sum, weight](const int i, const std::uint32_t l, const std::uint32_t c, const std::uint32_t r) {
+            const std::uint32_t wc = c != 0xFFFF ? 2 : 0;
+            const std::uint32_t wl = l != 0xFFFF ? 1 : 0;
+            const std::uint32_t wr = r != 0xFFFF ? 1 : 0;
+            sum[i] = wl * l + wc * c + wr * r;
+            weight[i] = wl + wc + wr;
+        };
+        filter(0, 0xFFFF, row[0], width > 1 ? row[1] : 0xFFFF);
+        for (auto i = 1; i + 1 < out_width; i++) filter(i, row[2 * i - 1], row[2 * i], row[2 * i + 1]);
+        const auto last = out_width - 1;
+        if (last > 0) filter(last, row[2 * last - 1], row[2 * last], 2 * last + 1 < width ? row[2 * last + 1] : 0xFFFF);
+    };
+
+    for (auto j = 0; j < out_height; j++)
+    {
+        const auto y = 2 * j;
+        if (y > 0)
+        {
+            std::swap(sums[0], sums[2]);
+            std::swap(weights[0], weights[2]);
+        }
+        else
+        {
+            std::fill(sums[0].begin(), sums[0].end(), 0);
+            std::fill(weights[0].begin(), weights[0].end(), 0);
+        }
+        filter_row(y, sums[1].data(), weights[1].data());
+        if (y + 1 < height) filter_row(y + 1, sums[2].data(), weights[2].data());
+        else
+        {
+            std::fill(sums[2].begin(), sums[2].end(), 0);
+            std::fill(weights[2].begin(), weights[2].end(), 0);
+        }
+
+        std::uint16_t* row = out + static_cast<std::size_t>(j) * out_width;
+        const std::uint32_t* above = sums[0].data();
+        const std::uint32_t* at = sums[1].data();
+        const std::uint32_t* below = sums[2].data();
+        const std::uint32_t* weight_above = weights[0].data();
+        const std::uint32_t* weight_at = weights[1].data();
+        const std::uint32_t* weight_below = weights[2].data();
+        for (auto i = 0; i < out_width; i++)
+        {
+            const auto sum = static_cast<std::int32_t>(above[i] + 2 * at[i] + below[i]);
+            const auto weight = static_cast<std::int32_t>(weight_above[i] + 2 * weight_at[i] + weight_below[i]);
+            const auto value = static_cast<std::int32_t>(
+                static_cast<float>(sum + weight / 2) / static_cast<float>(weight > 0 ? weight : 1)
+            );
+            row[i] = static_cast<std::uint16_t>(weight > 0 ? value : 0xFFFF);
+        }
+    }
+}
+
+/*
+ * 64-bit hash (MurmurHash64A)
+ *
+ * Chain calls through 'seed' to hash discontiguous spans
+ */
+std::uint64_t hash64(const void* data, const std::size_t size, const std::uint64_t seed = 0) {
+    const std::uint64_t m = 0xc6a4a7935bd1e995ULL;
+    const int r = 47;
+    const std::uint8_t* bytes = reinterpret_cast<const std::uint8_t*>(data);
+    std::uint64_t h = seed ^ (size * m);
+    std::uint64_t k = 0;
+    std::size_t i = 0;
+    for (; i + sizeof(k) <= size; i += sizeof(k))
+    {
+        std::memcpy(&k, bytes + i, sizeof(k));
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+        h ^= k;
+        h *= m;
+    }
+    if (i < size)
+    {
+        k = 0;
+        for (std::size_t j = size; j > i; j--) k = (k << 8) | bytes[j - 1];
+        h ^= k;
+        h *= m;
+    }
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+    return h;
+}
+
+/*
+ * Size of a file in bytes, -1 if it cannot be opened
+ */
+std::int64_t file_size(const char* filename) {
+    CFile file = CFile(std::fopen(filename, "rb"), [](FILE* f)->void { std::fclose(f); });
+    if (!file.get()) return -1;
+    FSEEK64(file.get(), 0, SEEK_END);
+    return FTELL64(file.get());
+}
+
+/*
+ * Modification time of a file in seconds, -1 if it cannot be found
+ */
+std::int64_t file_time(const char* filename) {
+#if defined(_MSC_VER)
+    struct _stat64 status;
+    if (_stat64(filename, &status) != 0) return -1;
+#else
+    struct stat status;
+    if (stat(filename, &status) != 0) return -1;
+#endif
+    return static_cast<std::int64_t>(status.st_mtime);
+}
+
+/*
+ * Output Manifest
+ *
+ * Written next to the outputs of a HGT source. Records the content hash of the source,
+ * the settings it was converted with, its range and the source and output hashes of each subtile.
+ */
+struct ManifestTile {
+    std::uint64_t source_hash;
+    std::uint64_t png_hash;
+    std::int64_t  png_size;
+};
+
+struct Manifest {
+    std::uint64_t source_hash = 0;
+    std::string settings;
+    int minimum = 0;
+    int maximum = 0;
+    std::map<std::string, ManifestTile> tiles;
+};
+
+bool read_manifest(const std::string& filename, Manifest& manifest) {
+    CFile file = CFile(std::fopen(filename.c_str(), "r"), [](FILE* f)->void { std::fclose(f); });
+    if (!file.get()) return false;
+
+    char line[512];
+    while (std::fgets(line, sizeof(line), file.get()))
+    {
+        char name[256];
+        ManifestTile tile;
+        if (std::strncmp(line, "settings ", 9) == 0)
+        {
+            manifest.settings = std::string(line + 9);
+            manifest.settings.erase(manifest.settings.find_last_not_of("\r\n") + 1);
+        }
+        else if (std::sscanf(line, "source %" SCNx64, &manifest.source_hash) == 1) {}
+        else if (std::sscanf(line, "range %d %d", &manifest.minimum, &manifest.maximum) == 2) {}
+        else if (std::sscanf(line, "tile %255s %" SCNx64 " %" SCNx64 " %" SCNd64,
+                             name, &tile.source_hash, &tile.png_hash, &tile.png_size) == 4)
+        {
+            manifest.tiles[name] = tile;
+        }
+    }
+    return true;
+}
+
+bool write_manifest(const std::string& filename, const Manifest& manifest) {
+    CFile file = CFile(std::fopen(filename.c_str(), "w"), [](FILE* f)->void { std::fclose(f); });
+    if (!file.get()) return false;
+
+    std::fprintf(file.get(), "hgt2png-manifest 2\n");
+    std::fprintf(file.get(), "source %016" PRIx64 "\n", manifest.source_hash);
+    std::fprintf(file.get(), "settings %s\n", manifest.settings.c_str());
+    std::fprintf(file.get(), "range %d %d\n", manifest.minimum, manifest.maximum);
+    for (const auto& entry : manifest.tiles)
+    {
+        std::fprintf(file.get(), "tile %s %016" PRIx64 " %016" PRIx64 " %" PRId64 "\n",
+            entry.first.c_str(),
+            entry.second.source_hash, entry.second.png_hash, entry.second.png_size
+        );
+    }
+    return std::ferror(file.get()) == 0;
+}
+
+/*
+ * Source Statistics
+ *
+ * A sidecar written next to the outputs of a HGT source. Records the size and modification
+ * time of the source it was gathered from, so it is trusted without reading the raster again,
+ * with the content hash, range, void count, a few percentiles and the histogram of the heights
+ * as 'value count' pairs.
+ */
+struct SourceStats {
+    std::int64_t size = -1;
+    std::int64_t modified = -1;
+    std::uint64_t source_hash = 0;
+    int minimum = 32768;
+    int maximum = -32768;
+    std::int64_t voids = 0;
+    std::map<int, std::int64_t> histogram;
+};
+
+bool read_stats(const std::string& filename, SourceStats& stats) {
+    CFile file = CFile(std::fopen(filename.c_str(), "r"), [](FILE* f)->void { std::fclose(f); });
+    if (!file.get()) return false;
+
+    char line[128];
+    if (!std::fgets(line, sizeof(line), file.get()) || std::strcmp(line, "hgt2png-stats 1\n") != 0) return false;
+    while (std::fgets(line, sizeof(line), file.get()))
+    {
+        int value = 0;
+        std::int64_t count = 0;
+        if (std::sscanf(line, "file %" SCNd64 " %" SCNd64, &stats.size, &stats.modified) == 2) {}
+        else if (std::sscanf(line, "source %" SCNx64, &stats.source_hash) == 1) {}
+        else if (std::sscanf(line, "range %d %d", &stats.minimum, &stats.maximum) == 2) {}
+        else if (std::sscanf(line, "voids %" SCNd64, &stats.voids) == 1) {}
+        else if (std::sscanf(line, "%d %" SCNd64, &value, &count) == 2) stats.histogram[value] = count;
+    }
+    return std::ferror(file.get()) == 0;
+}
+
+/*
+ * A histogram counts each signed height at the index of its 16 bit pattern, voids at 0x8000.
+ * A percentile is the lowest valid height with at least 'percent' of the valid heights at or below it.
+ */
+int histogram_percentile(const std::vector<std::int64_t>& histogram, const double percent) {
+    std::int64_t total = 0;
+    for (auto value = -32767; value <= 32767; value++) total += histogram[static_cast<std::uint16_t>(value)];
+    const auto target = std::max<std::int64_t>(1, static_cast<std::int64_t>(std::ceil(percent / 100.0 * static_cast<double>(total))));
+    std::int64_t count = 0;
+    for (auto value = -32767; value <= 32767; value++)
+    {
+        count += histogram[static_cast<std::uint16_t>(value)];
+        if (count >= target) return value;
+    }
+    return 0;
+}
+
+std::vector<std::int64_t> stats_histogram(const SourceStats& stats) {
+    std::vector<std::int64_t> histogram(65536);
+    for (const auto& entry : stats.histogram) histogram[static_cast<std::uint16_t>(entry.first)] = entry.second;
+    return histogram;
+}
+
+bool write_stats(const std::string& filename, const SourceStats& stats) {
+    CFile file = CFile(std::fopen(filename.c_str(), "w"), [](FILE* f)->void { std::fclose(f); });
+    if (!file.get()) return false;
+
+    const auto histogram = stats_histogram(stats);
+    const double percents[] = { 1.0, 5.0, 25.0, 50.0, 75.0, 95.0, 99.0 };
+
+    std::fprintf(file.get(), "hgt2png-stats 1\n");
+    std::fprintf(file.get(), "file %" PRId64 " %" PRId64 "\n", stats.size, stats.modified);
+    std::fprintf(file.get(), "source %016" PRIx64 "\n", stats.source_hash);
+    std::fprintf(file.get(), "range %d %d\n", stats.minimum, stats.maximum);
+    std::fprintf(file.get(), "voids %" PRId64 "\n", stats.voids);
+    for (const auto percent : percents)
+    {
+        std::fprintf(file.get(), "percentile %g %d\n", percent, histogram_percentile(histogram, percent));
+    }
+    for (const auto& entry : stats.histogram)
+    {
+        std::fprintf(file.get(), "%d %" PRId64 "\n", entry.first, entry.second);
+    }
+    return std::ferror(file.get()) == 0;
+}
+
+/*
+ * Append printf formatted text to a string
+ */
+void appendf(std::string& out, const char* format, ...) {
+    char buffer[1024];
+    va_list args;
+    va_start(args, format);
+    const auto length = std::vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    if (length > 0) out.append(buffer, std::min(static_cast<std::size_t>(length), sizeof(buffer) - 1));
+}
+
+/*
+ * Thread Pool
+ *
+ * A work stealing scheduler. Every worker owns a deque, taking its own tasks from
+ * the front and, once it runs dry, stealing from the back of the others. Each batch
+ * of tasks is dealt across the deques in order of decreasing predicted cost, so the
+ * expensive subtiles start first and the cheap ones fill the gaps at the end.
+ */
+struct Task {
+    std::uint64_t cost;
+    std::function<void()> run;
+};
+
+class ThreadPool {
+public:
+    explicit ThreadPool(const unsigned count) : queues(count) {
+        for (unsigned i = 0; i < count; i++) workers.emplace_back([this, i]() { run(i); });
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stopping = true;
+        }
+        ready.notify_all();
+        for (auto& worker : workers) worker.join();
+    }
+
+    void submit(std::vector<Task> tasks) {
+        std::stable_sort(tasks.begin(), tasks.end(), [](const Task& a, const Task& b) { return a.cost > b.cost; });
+        const auto count = queues.size();
+        outstanding += tasks.size();
+        const auto first = next.fetch_add(tasks.size());
+        for (std::size_t i = 0; i < tasks.size(); i++)
+        {
+            Queue& queue = queues[(first + i) % count];
+            std::lock_guard<std::mutex> guard(queue.lock);
+            queue.tasks.push_back(std::move(tasks[i].run));
+        }
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            queued += tasks.size();
+        }
+        ready.notify_all();
+    }
+
+    /*
+     * Block until every submitted task has finished
+     */
+    void wait() {
+        std::unique_lock<std::mutex> guard(lock);
+        idle.wait(guard, [this]() { return outstanding == 0; });
+    }
+
+private:
+    struct Queue {
+        std::deque<std::function<void()>> tasks;
+        std::mutex lock;
+    };
+
+    bool take(const unsigned self, std::function<void()>& task) {
+        const auto count = static_cast<unsigned>(queues.size());
+        for (unsigned i = 0; i < count; i++)
+        {
+            Queue& queue = queues[(self + i) % count];
+            std::lock_guard<std::mutex> guard(queue.lock);
+            if (queue.tasks.empty()) continue;
+            if (i == 0)
+            {
+                task = std::move(queue.tasks.front());
+                queue.tasks.pop_front();
+            }
+            else
+            {
+                task = std::move(queue.tasks.back());
+                queue.tasks.pop_back();
+            }
+            queued--;
+            return true;
+        }
+        return false;
+    }
+
+    void run(const unsigned self) {
+        for (;;)
+        {
+            std::function<void()> task;
+            if (!take(self, task))
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                ready.wait(guard, [this]() { return stopping || queued > 0; });
+                if (stopping && queued == 0) return;
+                continue;
+            }
+            task();
+            if (--outstanding == 0)
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                idle.notify_all();
+            }
+        }
+    }
+
+    std::vector<std::thread> workers;
+    std::vector<Queue> queues;
+    std::atomic<std::size_t> next{0};
+    std::atomic<std::size_t> queued{0};
+    std::atomic<std::size_t> outstanding{0};
+    std::mutex lock;
+    std::condition_variable ready;
+    std::condition_variable idle;
+    bool stopping = false;
+};
+
+/*
+ * Buffer Pool
+ *
+ * Bounds the rasters in flight, read ahead or still encoding, to 'depth'.
+ * Released buffers keep their capacity so later sources are read without reallocating.
+ */
+class BufferPool {
+public:
+    explicit BufferPool(const unsigned depth) : available(depth) {}
+
+    std::vector<std::uint8_t> acquire() {
+        std::unique_lock<std::mutex> guard(lock);
+        released.wait(guard, [this]() { return available > 0; });
+        available--;
+        std::vector<std::uint8_t> buffer;
+        if (!buffers.empty())
+        {
+            buffer = std::move(buffers.back());
+            buffers.pop_back();
+        }
+        return buffer;
+    }
+
+    void release(std::vector<std::uint8_t>&& buffer) {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            buffers.push_back(std::move(buffer));
+            available++;
+        }
+        released.notify_one();
+    }
+
+private:
+    std::vector<std::vector<std::uint8_t>> buffers;
+    std::mutex lock;
+    std::condition_variable released;
+    unsigned available;
+};
+
+/*
+ * Mapped File
+ *
+ * A read only view of a whole file, memory mapped where the platform allows
+ */
+class MappedFile {
+public:
+    ~MappedFile() {
+#if !defined(_MSC_VER)
+        if (mapping) munmap(mapping, length);
+#endif
+    }
+
+    bool open(const char* filename) {
+#if !defined(_MSC_VER)
+        const int fd = ::open(filename, O_RDONLY);
+        if (fd < 0) return false;
+        struct stat status;
+        if (fstat(fd, &status) == 0 && status.st_size > 0)
+        {
+            void* view = mmap(nullptr, static_cast<std::size_t>(status.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (view != MAP_FAILED)
+            {
+                mapping = view;
+                length = static_cast<std::size_t>(status.st_size);
+                bytes = static_cast<const std::uint8_t*>(view);
+            }
+        }
+        ::close(fd);
+        return bytes != nullptr;
+#else
+        CFile file = CFile(std::fopen(filename, "rb"), [](FILE* f)->void { std::fclose(f); });
+        if (!file.get()) return false;
+        FSEEK64(file.get(), 0, SEEK_END);
+        fallback.resize(static_cast<std::size_t>(FTELL64(file.get())));
+        FSEEK64(file.get(), 0, SEEK_SET);
+        if (fallback.empty() || std::fread(fallback.data(), fallback.size(), 1, file.get()) != 1) return false;
+        bytes = fallback.data();
+        length = fallback.size();
+        return true;
+#endif
+    }
+
+    const std::uint8_t* data() const { return bytes; }
+    std::size_t size() const { return length; }
+
+private:
+    const std::uint8_t* bytes = nullptr;
+    std::size_t length = 0;
+    void* mapping = nullptr;
+    std::vector<std::uint8_t> fallback;
+};
+
+/*
+ * Shared Raster
+ *
+ * A POSIX shared memory segment holding a converted raster for every process converting the
+ * same source. A control block with the state of the segment and the number of processes
+ * attached leads the payload. The process creating the segment converts into it and marks
+ * it ready, the others wait for that and attach, and the last to detach removes it.
+ * A segment whose creator died before marking it ready is removed and created again.
+ */
+class SharedRaster {
+public:
+    ~SharedRaster() { detach(); }
+
+    /*
+     * Attach to the ready segment 'segment', or create it when 'create' is set and none exists.
+     * Returns true once attached, a created segment returns false until it is published.
+     */
+    bool attach(const std::string& segment, const std::size_t size, const bool create) {
+#if !defined(_MSC_VER)
+        name = segment;
+        length = control_size + size;
+        int fd = create ? shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600) : -1;
+        owner = fd >= 0;
+        if (!owner) fd = shm_open(name.c_str(), O_RDWR, 0600);
+        if (fd < 0) return false;
+        if (owner && ftruncate(fd, static_cast<off_t>(length)) != 0)
+        {
+            ::close(fd);
+            shm_unlink(name.c_str());
+            owner = false;
+            return false;
+        }
+
+        /*
+         * A segment just created by another process may not be sized yet
+         */
+        struct stat status;
+        bool sized = owner;
+        for (auto wait = 0; !sized && fstat(fd, &status) == 0 && wait < 100; wait++)
+        {
+            sized = static_cast<std::size_t>(status.st_size) == length;
+            if (!sized) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        void* view = sized ? mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+        ::close(fd);
+        if (view == MAP_FAILED)
+        {
+            if (owner) shm_unlink(name.c_str());
+            owner = false;
+            return false;
+        }
+        mapping = view;
+        if (owner)
+        {
+            control()->references.store(1);
+            control()->creator.store(static_cast<int>(getpid()));
+            return false;
+        }
+
+        /*
+         * Wait for the creator to convert, then attach unless the last process already detached
+         */
+        for (auto wait = 0; control()->state.load() == converting && wait < 1000; wait++)
+        {
+            const int creator = control()->creator.load();
+            int state = converting;
+            if (creator > 0 && kill(static_cast<pid_t>(creator), 0) != 0 && errno == ESRCH &&
+                control()->state.compare_exchange_strong(state, abandoned))
+            {
+                shm_unlink(name.c_str());
+                munmap(mapping, length);
+                mapping = nullptr;
+                return attach(segment, size, create);
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        int references = control()->references.load();
+        while (control()->state.load() == ready && references > 0 &&
+               !control()->references.compare_exchange_weak(references, references + 1)) {}
+        attached = control()->state.load() == ready && references > 0;
+        if (!attached)
+        {
+            munmap(mapping, length);
+            mapping = nullptr;
+        }
+        return attached;
+#else
+        (void)segment;
+        (void)size;
+        (void)create;
+        return false;
+#endif
+    }
+
+    void publish() {
+        control()->state.store(ready);
+        attached = true;
+    }
+
+    void detach() {
+#if !defined(_MSC_VER)
+        if (!mapping) return;
+        if (owner && !attached)
+        {
+            control()->state.store(abandoned);
+            shm_unlink(name.c_str());
+        }
+        else if (control()->references.fetch_sub(1) == 1)
+        {
+            shm_unlink(name.c_str());
+        }
+        munmap(mapping, length);
+        mapping = nullptr;
+#endif
+    }
+
+    bool creating() const { return mapping && owner && !attached; }
+    bool ready_to_read() const { return mapping && attached; }
+    std::uint8_t* data() const { return static_cast<std::uint8_t*>(mapping) + control_size; }
+    const std::string& segment() const { return name; }
+
+private:
+    enum { converting = 0, ready = 1, abandoned = 2 };
+    static const std::size_t control_size = 64;
+    struct Control {
+        std::atomic<int> state;
+        std::atomic<int> references;
+        std::atomic<int> creator;
+    };
+    Control* control() const { return static_cast<Control*>(mapping); }
+
+    std::string name;
+    void* mapping = nullptr;
+    std::size_t length = 0;
+    bool owner = false;
+    bool attached = false;
+};
+
+/*
+ * Products
+ *
+ * What an output mode writes. 'a' and 'r' encode the heights themselves, every other
+ * product is derived from the signed heights by one pass over the rows of the source.
+ */
+enum class Product {
+    Elevation,
+    Hillshade,
+    Slope,
+    Aspect,
+    Normal,
+    TerrainRgb,
+    Terrarium,
+    Relief
+};
+
+/*
+ * The 16 bit products encode 'minf' to 0 and 'minf' + 'deltaf' to 65534, as the relative mode does.
+ * The 'stencil' products need the gradients around each sample, the others only the sample.
+ */
+const struct ProductName {
+    Product product;
+    const char* name;
+    PngFormat format;
+    double minf;
+    double deltaf;
+    bool stencil;
+} product_names[] = {
+    { Product::Hillshade, "hillshade", { 1, 8, nullptr, nullptr }, 0.0, 0.0, true },
+    { Product::Slope, "slope", { 1, 16, "SLOPE", "degrees" }, 0.0, 90.0, true },
+    { Product::Aspect, "aspect", { 1, 16, "ASPECT", "degrees" }, 0.0, 360.0, true },
+    { Product::Normal, "normal", { 3, 8, nullptr, nullptr }, 0.0, 0.0, true },
+    { Product::TerrainRgb, "terrain-rgb", { 3, 8, nullptr, nullptr }, 0.0, 0.0, false },
+    { Product::Terrarium, "terrarium", { 3, 8, nullptr, nullptr }, 0.0, 0.0, false },
+    { Product::Relief, "relief", { 4, 8, nullptr, nullptr }, 0.0, 0.0, false }
+};
+
+const ProductName* find_product(const Product product) {
+    for (const auto& entry : product_names)
+    {
+        if (entry.product == product) return &entry;
+    }
+    return nullptr;
+}
+
+/*
+ * Options
+ *
+ * The positional arguments and the '--' flags, shared by every source of a run.
+ * 'absolute', 'product' and 'prefix' are those of the first of the output 'modes', every
+ * source is tiled by each of the 'schemes', the first of which is 'rows' x 'cols'.
+ * The sources hold 'source_width' x 'source_height' samples, resampled to 'width' x 'height'
+ * with 'filter' when 'resize' is set.
+ */
+struct OutputMode {
+    bool absolute;
+    Product product;
+    std::string prefix;
+};
+
+/*
+ * A mode is named 'a', 'r' or by its product
+ */
+bool parse_mode(const std::string& name, OutputMode& mode) {
+    mode.absolute = name == "a";
+    mode.product = Product::Elevation;
+    if (name == "a" || name == "r") return true;
+    for (const auto& entry : product_names)
+    {
+        mode.product = entry.product;
+        if (name == entry.name) return true;
+    }
+    return false;
+}
+
+const char* mode_name(const OutputMode& mode) {
+    if (mode.product != Product::Elevation) return find_product(mode.product)->name;
+    return mode.absolute ? "absolute" : "relative";
+}
+
+/*
+ * Resampling Filters
+ *
+ * Bilinear reaches 1 sample either side, bicubic (Catmull-Rom) 2 and Lanczos 3,
+ * widened by the scale factor when shrinking so every input sample contributes.
+ */
+enum class Filter { Bilinear, Bicubic, Lanczos };
+
+const struct {
+    Filter filter;
+    const char* name;
+    double support;
+} filter_names[] = {
+    { Filter::Bilinear, "bilinear", 1.0 },
+    { Filter::Bicubic,  "bicubic",  2.0 },
+    { Filter::Lanczos,  "lanczos",  3.0 },
+};
+
+double filter_weight(const Filter filter, double x) {
+    const double pi = 3.14159265358979323846;
+    x = std::fabs(x);
+    switch (filter)
+    {
+    case Filter::Bilinear:
+        return x < 1.0 ? 1.0 - x : 0.0;
+    case Filter::Bicubic:
+        if (x < 1.0) return (1.5 * x - 2.5) * x * x + 1.0;
+        return x < 2.0 ? ((-0.5 * x + 2.5) * x - 4.0) * x + 2.0 : 0.0;
+    case Filter::Lanczos:
+        if (x < 1e-9) return 1.0;
+        return x < 3.0 ? 3.0 * std::sin(pi * x) * std::sin(pi * x / 3.0) / (pi * pi * x * x) : 0.0;
+    }
+    return 0.0;
+}
+
+struct Scheme {
+    int rows;
+    int cols;
+    int subwidth;
+    int subheight;
+};
+
+struct Options {
+    bool absolute = false;
+    Product product = Product::Elevation;
+    std::string prefix;
+    std::vector<OutputMode> modes;
+    int width = 0;
+    int height = 0;
+    int source_width = 0;
+    int source_height = 0;
+    bool resize = false;
+    Filter filter = Filter::Bicubic;
+    int rows = 1;
+    int cols = 1;
+    int subwidth = 0;
+    int subheight = 0;
+    std::vector<Scheme> schemes;
+    int overlap = -1;
+    bool tile_size = false;
+    bool pad = false;
+    int levels = 0;
+    int zoom_min = -1;
+    int zoom_max = -1;
+    int xyz_size = 256;
+    int mosaic_width = 0;
+    int mosaic_height = 0;
+    bool roi = false;
+    bool bbox = false;
+    double bbox_south = 0.0;
+    double bbox_west = 0.0;
+    double bbox_north = 0.0;
+    double bbox_east = 0.0;
+    std::vector<std::pair<int, int>> tiles;
+    bool global_range = false;
+    int global_minimum = 0;
+    int global_maximum = 0;
+    std::string cache;
+    std::int64_t cache_limit = 1024;
+    bool shm = false;
+    int fill = 0;
+    int contours = 0;
+    bool mesh = false;
+    double mesh_error = 1.0;
+    bool clip = false;
+    double clip_low = 1.0;
+    double clip_high = 99.0;
+    double sun_azimuth = 315.0;
+    double sun_altitude = 45.0;
+    std::shared_ptr<const std::vector<std::uint8_t>> relief;
+    bool relief_alpha = false;
+    std::uint64_t relief_hash = 0;
+    bool manifest = false;
+    unsigned threads = 0;
+    unsigned prefetch = 2;
+};
+
+/*
+ * The pixel format of a product, relief is RGBA only when its ramp gives an alpha
+ */
+PngFormat product_format(const Options& options, const Product product) {
+    if (product == Product::Elevation) return elevation_format;
+    PngFormat format = find_product(product)->format;
+    if (product == Product::Relief && !options.relief_alpha) format.channels = 3;
+    return format;
+}
+
+/*
+ * Read a color ramp into the RGBA lookup table of every height
+ *
+ * Each line holds a height in meters and its red, green, blue and optionally alpha,
+ * 'nv' in place of the height sets the color of voids, transparent black by default.
+ * Heights between two entries blend their colors, those beyond the ends take the end colors.
+ * The table is indexed by the 16 bit pattern of a signed height.
+ */
+bool read_ramp(const char* filename, Options& options) {
+    CFile file = CFile(std::fopen(filename, "r"), [](FILE* f)->void { std::fclose(f); });
+    if (!file.get()) return false;
+
+    std::map<double, std::array<double, 4>> ramp;
+    std::array<std::uint8_t, 4> void_color = { { 0, 0, 0, 0 } };
+    char line[256];
+    while (std::fgets(line, sizeof(line), file.get()))
+    {
+        char key[32];
+        std::array<double, 4> color = { { 0.0, 0.0, 0.0, 255.0 } };
+        const auto fields = std::sscanf(line, "%31s %lf %lf %lf %lf", key, &color[0], &color[1], &color[2], &color[3]);
+        if (fields < 1 || key[0] == '#') continue;
+        if (fields < 4) return false;
+        options.relief_alpha = options.relief_alpha || fields == 5;
+        for (auto& channel : color) channel = std::min(255.0, std::max(0.0, channel));
+        if (std::strcmp(key, "nv") == 0)
+        {
+            for (auto c = 0; c < 4; c++) void_color[c] = static_cast<std::uint8_t>(color[c]);
+            options.relief_alpha = true;
+            continue;
+        }
+        char* end = nullptr;
+        const double height = std::strtod(key, &end);
+        if (*end != '\0') return false;
+        ramp[height] = color;
+    }
+    if (ramp.empty() || std::ferror(file.get())) return false;
+
+    std::vector<std::uint8_t> relief(65536 * 4);
+    for (auto value = -32768; value <= 32767; value++)
+    {
+        std::uint8_t* rgba = &relief[4 * static_cast<std::uint16_t>(value)];
+        if (value == -32768)
+        {
+            std::copy(void_color.begin(), void_color.end(), rgba);
+            continue;
+        }
+        const auto above = ramp.lower_bound(value);
+        const auto below = above == ramp.begin() ? above : std::prev(above);
+        const auto& high = above == ramp.end() ? below->second : above->second;
+        const auto& low = below->second;
+        const double t = above == ramp.end() || above == below || above->first == below->first ?
+            1.0 : (value - below->first) / (above->first - below->first);
+        for (auto c = 0; c < 4; c++) rgba[c] = static_cast<std::uint8_t>(low[c] + (high[c] - low[c]) * t + 0.5);
+    }
+    options.relief_hash = hash64(relief.data(), relief.size());
+    options.relief = std::make_shared<const std::vector<std::uint8_t>>(std::move(relief));
+    return true;
+}
+
+/*
+ * Level
+ *
+ * The converted raster at one resolution, level 0 is the source itself
+ * and each overview level halves the resolution of the previous one.
+ * 'data' starts at row 'first_row', only a region of the source may be loaded,
+ * and holds pixels in the format of the source's product.
+ */
+struct Level {
+    int width;
+    int height;
+    int first_row;
+    const std::uint8_t* data;
+    PngCalibration calibration;
+};
+
+/*
+ * Source
+ *
+ * The state of one HGT source from the moment it is read until its last subtile is written.
+ * Each further output mode is a source derived from the first, sharing its read and scan.
+ */
+struct Source {
+    std::string filename;
+    std::string base_name;
+    std::string report;
+    std::string error;
+    std::int64_t size = 0;
+    int latitude = 0;
+    int longitude = 0;
+    std::vector<std::uint8_t> raster;
+    std::vector<std::vector<std::uint16_t>> overviews;
+    std::vector<Level> levels;
+    std::vector<Subtile> subtiles;
+    std::vector<ManifestTile> outputs;
+    Manifest previous;
+    Manifest manifest;
+    bool reusable = false;
+    bool absolute = false;
+    Product product = Product::Elevation;
+    PngFormat format = elevation_format;
+    bool derived = false;
+    bool cached = false;
+    MappedFile cache;
+    SharedRaster shared;
+    std::int64_t voids = 0;
+    bool filled = false;
+    bool empty = false;
+    std::mutex lock;
+    std::atomic<int> remaining{0};
+    std::atomic<bool> started{false};
+    std::atomic<int> constant_count{0};
+    std::atomic<int> unchanged_count{0};
+    std::atomic<std::size_t> png_size{0};
+};
+
+/*
+ * Output names
+ *
+ * The outputs of a source share its file name, less the extension, behind the output prefix
+ */
+std::string output_base_name(const std::string& prefix, const std::string& filename) {
+    const char* last_slash = std::strrchr(filename.c_str(), DIRECTORY_DELIM);
+    std::string base_name = prefix + (last_slash ? last_slash + 1 : filename.c_str());
+    base_name.erase(base_name.find_last_of("."), std::string::npos);
+    return base_name;
+}
+
+/*
+ * A subtile is named by its offsets, overview subtiles are prefixed by their level
+ * and, when there are several, every subtile by the subdivision of its scheme
+ *
+ *     <Output Prefix><SOURCE>.<Row>.<Col>.png
+ *     <Output Prefix><SOURCE>.L<Level>.<Row>.<Col>.png
+ *     <Output Prefix><SOURCE>.<Rows>x<Cols>.[L<Level>.]<Row>.<Col>.png
+ */
+std::string subtile_name(const Subtile& subtile, const Options& options) {
+    const Scheme& scheme = options.schemes[subtile.scheme];
+    return
+        (options.schemes.size() > 1 ? std::to_string(scheme.rows) + "x" + std::to_string(scheme.cols) + "." : std::string()) +
+        (subtile.level > 0 ? "L" + std::to_string(subtile.level) + "." : std::string()) +
+        std::to_string(subtile.row_offset) + "." + std::to_string(subtile.col_offset);
+}
+
+std::string subtile_path(const Source& source, const Subtile& subtile, const Options& options) {
+    return source.base_name + "." + subtile_name(subtile, options) + ".png";
+}
+
+/*
+ * Run
+ *
+ * The scheduler, caches and aggregate statistics shared by every source
+ */
+struct Run {
+    Options options;
+    ThreadPool* pool = nullptr;
+    BufferPool* buffers = nullptr;
+    ConstantCache constants;
+    std::mutex lock;
+    std::vector<std::string> failures;
+    std::atomic<int> converted{0};
+    std::atomic<int> skipped{0};
+    std::atomic<int> empty{0};
+    std::atomic<int> subtiles{0};
+    std::atomic<std::int64_t> source_bytes{0};
+    std::atomic<std::int64_t> png_bytes{0};
+    std::condition_variable read_ahead;
+    unsigned waiting = 0;
+    unsigned in_flight = 0;
+    double xyz_minf = 0.0;
+    double xyz_deltaf = 0.0;
+};
+
+/*
+ * Expand a <HGT Source> into a list of HGT files
+ *
+ * A directory contributes every '.hgt' file it holds, a pattern containing '*', '?' or '['
+ * is globbed and '@FILE' lists one source per line. Anything else is a single source.
+ */
+bool ends_with_hgt(const std::string& name) {
+    if (name.size() < 4) return false;
+    std::string extension = name.substr(name.size() - 4);
+    for (auto& c : extension) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    return extension == ".hgt";
+}
+
+bool list_sources(const std::string& source, std::vector<std::string>& sources) {
+    if (!source.empty() && source[0] == '@')
+    {
+        CFile list = CFile(std::fopen(source.c_str() + 1, "r"), [](FILE* f)->void { std::fclose(f); });
+        if (!list.get()) return false;
+        char line[4096];
+        while (std::fgets(line, sizeof(line), list.get()))
+        {
+            std::string name(line);
+            name.erase(name.find_last_not_of(" \t\r\n") + 1);
+            if (!name.empty() && name[0] != '#') sources.push_back(name);
+        }
+        return true;
+    }
+#if !defined(_MSC_VER)
+    if (source.find_first_of("*?[") != std::string::npos)
+    {
+        glob_t matches;
+        if (glob(source.c_str(), 0, NULL, &matches) == 0)
+        {
+            for (std::size_t i = 0; i < matches.gl_pathc; i++) sources.push_back(matches.gl_pathv[i]);
+        }
+        globfree(&matches);
+        return true;
+    }
+    struct stat status;
+    if (stat(source.c_str(), &status) == 0 && S_ISDIR(status.st_mode))
+    {
+        DIR* directory = opendir(source.c_str());
+        if (!directory) return false;
+        std::vector<std::string> names;
+        while (struct dirent* entry = readdir(directory))
+        {
+            if (ends_with_hgt(entry->d_name)) names.push_back(entry->d_name);
+        }
+        closedir(directory);
+        std::sort(names.begin(), names.end());
+        const bool delimited = source[source.size() - 1] == DIRECTORY_DELIM;
+        for (const auto& name : names) sources.push_back(source + (delimited ? "" : std::string(1, DIRECTORY_DELIM)) + name);
+        return true;
+    }
+#endif
+    sources.push_back(source);
+    return true;
+}
+
+/*
+ * Location of a 1 degree raster, parsed from its filename
+ *
+ * 'hemi' and 'll' are as named (e.g. N36W113), the latitude
+ * and longitude are the signed coordinates of its south west corner
+ */
+struct Location {
+    char hemi[2];
+    int  ll[2];
+    int  latitude;
+    int  longitude;
+};
+
+bool parse_location(const char* file_name, Location& location) {
+    location = { { 0, 0 }, { -1, -1 }, 0, 0 };
+    std::sscanf(file_name, "%c%2d%c%3d", &location.hemi[0], &location.ll[0], &location.hemi[1], &location.ll[1]);
+    const bool valid_hemi[2] = {
+        location.hemi[0] == 'N' || location.hemi[0] == 'S',
+        location.hemi[1] == 'W' || location.hemi[1] == 'E'
+    };
+    location.latitude = location.hemi[0] == 'S' ? -location.ll[0] : location.ll[0];
+    location.longitude = location.hemi[1] == 'W' ? -location.ll[1] : location.ll[1];
+    return valid_hemi[0] && valid_hemi[1];
+}
+
+/*
+ * Read and verify a HGT source, its samples are left big endian
+ *
+ * Only the 'row_count' rows from 'first_row' on are read, all of them by default,
+ * none only verifies the source.
+ * Returns false with 'source.error' set on failure
+ */
+bool read_source(Source& source, const Options& options, const int first_row = 0, int row_count = -1) {
+    const auto width = options.source_width;
+    const auto height = options.source_height;
+    const auto pixel_count = static_cast<std::size_t>(width * height);
+
+    /*
+     * Read in the HGT (.hgt) file
+     * 
+     * Check that the file opened properly
+     */
+    const char* hgt_filename = source.filename.c_str();
+    CFile hgt_file = CFile(std::fopen(hgt_filename, "rb"), [](FILE* f)->void { std::fclose(f); });
+    if (!hgt_file.get())
+    {
+        appendf(source.error, "Could not open file \"%s\"", hgt_filename);
+        return false;
+    }
+
+    /*
+     * Extract the number of samples in the HGT raster
+     */
+    FSEEK64(hgt_file.get(), 0, SEEK_END);
+    const auto hgt_size = FTELL64(hgt_file.get());
+    FSEEK64(hgt_file.get(), 0, SEEK_SET);
+    appendf
+    (
+        source.report,
+        "File: \"%s\" (%" PRId64 " bytes)\nSize: %d(w) x %d(h) pixels (%zu samples)\n",
+        hgt_filename, hgt_size, width, height, pixel_count
+    );
+
+    /*
+     * Verify the size of the HGT raster
+     */
+    const auto data_size   = static_cast<std::decay<decltype(hgt_size)>::type>(pixel_count * sizeof(std::int16_t));
+    if (hgt_size != data_size)
+    {
+        appendf(source.error, "Actual size %" PRId64 ", Expected %" PRId64, hgt_size, data_size);
+        return false;
+    }
+    source.size = hgt_size;
+
+    /*
+     * Extract the location of the 1 degree raster from the filename
+     */
+    const char* last_slash = std::strrchr(hgt_filename, DIRECTORY_DELIM);
+    const char* file_name  = last_slash ? last_slash + 1 : hgt_filename;
+    Location location;
+    const bool valid = parse_location(file_name, location);
+    const auto& hemi = location.hemi;
+    const auto& ll = location.ll;
+    source.base_name = output_base_name(options.prefix, source.filename);
+    
+    /*
+     * Verify the filename raster coordinates
+     */
+    if (!valid)
+    {
+        const bool valid_north = hemi[0] == 'N' || hemi[0] == 'S';
+        appendf(source.error, "Inavlid hemisphere \"%c\" in \"%s\"", valid_north ? hemi[1] : hemi[0], file_name);
+        return false;
+    }
+    source.latitude = location.latitude;
+    source.longitude = location.longitude;
+    appendf(source.report, "Bounds: (%d%c, %d%c) to (%d%c, %d%c)\n",
+        ll[0], hemi[0], ll[1], hemi[1], ll[0] + 1, hemi[0], ll[1] + 1, hemi[1]
+    );
+
+    /*
+     * Extract the raster into memory
+     */
+    if (row_count < 0) row_count = height - first_row;
+    if (row_count == 0) return true;
+    const auto row_size = static_cast<std::int64_t>(width) * sizeof(std::int16_t);
+    std::vector<std::uint8_t>& raster = source.raster;
+    raster.resize(static_cast<std::size_t>(row_count * row_size));
+    FSEEK64(hgt_file.get(), first_row * row_size, SEEK_SET);
+    const auto read_size = std::fread(raster.data(), raster.size(), 1, hgt_file.get());
+    if (read_size != 1)
+    {
+        appendf(source.error, "Read size %zu, Expected 1", read_size);
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Raster Cache
+ *
+ * A converted raster kept by a previous run, <Cache>/<SOURCE>.<Mode>.raster. The header
+ * identifies the source by its size and modification time, so a hit needs no read of it,
+ * and is followed by the native endian unsigned 16 bit samples, mapped as they are.
+ * The least recently used rasters are removed once the cache exceeds its limit.
+ */
+struct RasterCacheHeader {
+    char magic[8];
+    std::uint32_t version;
+    std::int32_t width;
+    std::int32_t height;
+    std::int32_t absolute;
+    std::int32_t minimum;
+    std::int32_t maximum;
+    std::uint64_t source_hash;
+    std::int64_t source_size;
+    std::int64_t source_time;
+    std::int64_t voids;
+};
+static_assert(sizeof(RasterCacheHeader) == 64, "The samples of a cached raster start 64 bytes in");
+
+std::string raster_cache_name(const Options& options, const std::string& filename) {
+    return output_base_name(options.cache, filename) + (options.absolute ? ".a" : ".r") +
+        (options.fill > 0 ? ".f" + std::to_string(options.fill) : std::string()) +
+        (options.clip ? ".c" + std::to_string(options.clip_low) + "-" + std::to_string(options.clip_high) : std::string()) +
+        (options.global_range ? ".g" + std::to_string(options.global_minimum) + "-" + std::to_string(options.global_maximum) : std::string()) +
+        (options.resize ?
+            ".s" + std::to_string(options.width) + "x" + std::to_string(options.height) + filter_names[static_cast<int>(options.filter)].name :
+            std::string()) + ".raster";
+}
+
+const RasterCacheHeader& raster_cache_header(const Source& source) {
+    return *reinterpret_cast<const RasterCacheHeader*>(source.shared.ready_to_read() ? source.shared.data() : source.cache.data());
+}
+
+RasterCacheHeader make_raster_cache_header(const Source& source, const Options& options) {
+    RasterCacheHeader header = {};
+    std::memcpy(header.magic, "HGT2PNGR", 8);
+    header.version = 1;
+    header.width = options.width;
+    header.height = options.height;
+    header.absolute = options.absolute ? 1 : 0;
+    header.minimum = source.manifest.minimum;
+    header.maximum = source.manifest.maximum;
+    header.source_hash = source.manifest.source_hash;
+    header.source_size = file_size(source.filename.c_str());
+    header.source_time = file_time(source.filename.c_str());
+    header.voids = source.voids;
+    return header;
+}
+
+/*
+ * Open a cached raster
+ *
+ * The name carries every setting that changes the samples, the global range included,
+ * so a raster calibrated to a global range is never reused by a per-file run.
+ */
+bool open_raster_cache(Source& source, const Options& options) {
+    const std::string cache_name = raster_cache_name(options, source.filename);
+    const auto pixel_count = static_cast<std::size_t>(options.width) * options.height;
+    if (!source.cache.open(cache_name.c_str()) ||
+        source.cache.size() != sizeof(RasterCacheHeader) + pixel_count * sizeof(std::uint16_t)) return false;
+
+    const RasterCacheHeader& header = raster_cache_header(source);
+    const bool valid =
+        std::memcmp(header.magic, "HGT2PNGR", 8) == 0 && header.version == 1 &&
+        header.width == options.width && header.height == options.height &&
+        header.absolute == (options.absolute ? 1 : 0) &&
+        (!options.global_range || (header.minimum == options.global_minimum && header.maximum == options.global_maximum)) &&
+        header.source_size == file_size(source.filename.c_str()) &&
+        header.source_time == file_time(source.filename.c_str());
+    if (!valid) return false;
+
+#if defined(_MSC_VER)
+    _utime(cache_name.c_str(), nullptr);
+#else
+    utime(cache_name.c_str(), nullptr);
+#endif
+    return true;
+}
+
+/*
+ * Remove the least recently used rasters until the cache fits its limit, in MB
+ */
+void trim_raster_cache(const Options& options) {
+#if !defined(_MSC_VER)
+    DIR* listing = opendir(options.cache.c_str());
+    if (!listing) return;
+    std::vector<std::tuple<std::int64_t, std::int64_t, std::string>> rasters;
+    std::int64_t total = 0;
+    while (struct dirent* entry = readdir(listing))
+    {
+        const std::string name = entry->d_name;
+        if (name.size() < 7 || name.compare(name.size() - 7, 7, ".raster") != 0) continue;
+        const std::string path = options.cache + name;
+        const auto size = file_size(path.c_str());
+        rasters.emplace_back(file_time(path.c_str()), size, path);
+        total += size;
+    }
+    closedir(listing);
+
+    std::sort(rasters.begin(), rasters.end());
+    for (const auto& raster : rasters)
+    {
+        if (total <= options.cache_limit * 1000000) break;
+        if (std::remove(std::get<2>(raster).c_str()) == 0) total -= std::get<1>(raster);
+    }
+#else
+    (void)options;
+#endif
+}
+
+/*
+ * Write the converted raster of a whole source to the cache
+ */
+bool write_raster_cache(const Source& source, const Options& options) {
+    const std::string cache_name = raster_cache_name(options, source.filename);
+    const std::string partial_name = cache_name + ".partial";
+    const RasterCacheHeader header = make_raster_cache_header(source, options);
+    {
+        CFile file = CFile(std::fopen(partial_name.c_str(), "wb"), [](FILE* f)->void { std::fclose(f); });
+        if (!file.get() ||
+            std::fwrite(&header, sizeof(header), 1, file.get()) != 1 ||
+            std::fwrite(source.levels[0].data, static_cast<std::size_t>(options.width) * options.height * sizeof(std::uint16_t), 1, file.get()) != 1) return false;
+    }
+    std::remove(cache_name.c_str());
+    if (std::rename(partial_name.c_str(), cache_name.c_str()) != 0) return false;
+    trim_raster_cache(options);
+    return true;
+}
+
+/*
+ * Attach to the converted raster another process shares for the same source, mode and range,
+ * or create the segment to share this one. Regions are never shared, they are never whole.
+ */
+bool attach_shared_raster(Source& source, const Options& options) {
+    std::string key = source.filename;
+#if !defined(_MSC_VER)
+    char resolved[PATH_MAX];
+    if (realpath(source.filename.c_str(), resolved)) key = resolved;
+#endif
+    appendf(key, "|%" PRId64 "|%" PRId64 "|%c|%d|%d|%d|%g|%g|%dx%d|%s", file_size(source.filename.c_str()), file_time(source.filename.c_str()),
+        options.absolute ? 'a' : 'r', options.global_range ? options.global_minimum : 0, options.global_range ? options.global_maximum : 0,
+        options.fill, options.clip ? options.clip_low : 0.0, options.clip ? options.clip_high : 0.0,
+        options.width, options.height, options.resize ? filter_names[static_cast<int>(options.filter)].name : ""
+    );
+    char segment[32];
+    std::snprintf(segment, sizeof(segment), "/hgt2png-%016" PRIx64, hash64(key.data(), key.size()));
+
+    const auto pixel_count = static_cast<std::size_t>(options.width) * options.height;
+    if (!source.shared.attach(segment, sizeof(RasterCacheHeader) + pixel_count * sizeof(std::uint16_t), !options.roi)) return false;
+    const RasterCacheHeader& header = raster_cache_header(source);
+    return header.width == options.width && header.height == options.height && header.absolute == (options.absolute ? 1 : 0);
+}
+
+/*
+ * Share a raster converted into the segment this one created with the processes waiting on it
+ */
+void publish_shared_raster(Source& source, const Options& options) {
+    const RasterCacheHeader header = make_raster_cache_header(source, options);
+    std::memcpy(source.shared.data(), &header, sizeof(header));
+    source.shared.publish();
+    appendf(source.report, "Shared: \"%s\"\n", source.shared.segment().c_str());
+}
+
+/*
+ * The settings recorded in a manifest, outputs are only reused while they match
+ */
+std::string manifest_settings(const Options& options, const OutputMode& mode) {
+    std::string schemes;
+    for (const auto& scheme : options.schemes) schemes += std::to_string(scheme.rows) + " " + std::to_string(scheme.cols) + " ";
+    std::string product = mode.absolute ? "a " : "r ";
+    if (mode.product != Product::Elevation) product = std::string(find_product(mode.product)->name) + " ";
+    if (mode.product == Product::Hillshade) appendf(product, "%g %g ", options.sun_azimuth, options.sun_altitude);
+    if (mode.product == Product::Relief) appendf(product, "%016" PRIx64 " ", options.relief_hash);
+    return
+        product +
+        std::to_string(options.width) + " " + std::to_string(options.height) + " " +
+        schemes + std::to_string(options.levels) + " " +
+        (options.tile_size ?
+            std::to_string(options.subwidth) + "x" + std::to_string(options.subheight) + "+" +
+            std::to_string(options.overlap) + (options.pad ? " pad " : " truncate ") : std::string()) +
+        (options.global_range ?
+            "global " + std::to_string(options.global_minimum) + " " + std::to_string(options.global_maximum) + " " :
+            std::string()) +
+        (options.fill > 0 ? "fill " + std::to_string(options.fill) + " " : std::string()) +
+        (options.clip ? "clip " + std::to_string(options.clip_low) + " " + std::to_string(options.clip_high) + " " : std::string()) +
+        (options.contours > 0 ? "contours " + std::to_string(options.contours) + " " : std::string()) +
+        (options.mesh ? "mesh " + std::to_string(options.mesh_error) + " " : std::string()) +
+        (options.resize ?
+            std::string("resize ") + filter_names[static_cast<int>(options.filter)].name + " " +
+            std::to_string(options.source_width) + "x" + std::to_string(options.source_height) + " " :
+            std::string()) +
+        "libpng-" PNG_LIBPNG_VER_STRING "-default";
+}
+
+/*
+ * Run 'band' over bands of the rows 'begin' to 'end', one per worker, returning once all are done
+ *
+ * The calling thread takes bands as well, so it never waits on workers busy with other sources
+ */
+struct Bands {
+    std::atomic<int> next{0};
+    std::atomic<int> done{0};
+    std::mutex lock;
+    std::condition_variable finished;
+};
+
+void run_bands(Run& run, const int begin, const int end, const std::function<void(int, int)>& band) {
+    const auto rows = end - begin;
+    const auto count = std::max(1, std::min(static_cast<int>(run.options.threads), rows));
+    const auto bands = std::make_shared<Bands>();
+    const auto take = [bands, begin, rows, count](const std::function<void(int, int)>* band) {
+        for (auto index = bands->next++; index < count; index = bands->next++)
+        {
+            (*band)(begin + rows * index / count, begin + rows * (index + 1) / count);
+            if (++bands->done < count) continue;
+            std::lock_guard<std::mutex> guard(bands->lock);
+            bands->finished.notify_all();
+        }
+    };
+
+    std::vector<Task> tasks;
+    for (auto i = 1; i < count; i++) tasks.push_back({ std::numeric_limits<std::uint64_t>::max(), [take, &band]() { take(&band); } });
+    run.pool->submit(std::move(tasks));
+    take(&band);
+    std::unique_lock<std::mutex> guard(bands->lock);
+    bands->finished.wait(guard, [&bands, count]() { return bands->done == count; });
+}
+
+/*
+ * The taps of a separable resampling filter along one axis
+ *
+ * Output sample i sits at input position i * (in - 1) / (out - 1) so the corners of a
+ * source stay in place. Its 'count' weights start at input sample 'first' and are left
+ * unnormalized, each output divides by the weights of the samples that are not voids.
+ */
+struct FilterTaps {
+    int stride;
+    std::vector<int> first;
+    std::vector<int> count;
+    std::vector<int> nearest;
+    std::vector<float> weights;
+};
+
+FilterTaps make_filter_taps(const Filter filter, const int in_size, const int out_size) {
+    const auto& entry = filter_names[static_cast<int>(filter)];
+    const double scale = out_size > 1 ? static_cast<double>(in_size - 1) / (out_size - 1) : 0.0;
+    const double stretch = std::max(1.0, scale);
+    const double support = entry.support * stretch;
+
+    FilterTaps taps;
+    taps.stride = static_cast<int>(std::ceil(2.0 * support)) + 1;
+    taps.first.resize(out_size);
+    taps.count.resize(out_size);
+    taps.nearest.resize(out_size);
+    taps.weights.assign(static_cast<std::size_t>(out_size) * taps.stride, 0.0f);
+    for (auto i = 0; i < out_size; i++)
+    {
+        const double center = i * scale;
+        const auto first = std::max(0, static_cast<int>(std::ceil(center - support)));
+        const auto last = std::min(in_size - 1, static_cast<int>(std::floor(center + support)));
+        taps.first[i] = first;
+        taps.count[i] = std::min(taps.stride, last - first + 1);
+        taps.nearest[i] = std::min(in_size - 1, static_cast<int>(std::lround(center)));
+        for (auto k = 0; k < taps.count[i]; k++)
+        {
+            taps.weights[static_cast<std::size_t>(i) * taps.stride + k] =
+                static_cast<float>(filter_weight(filter, (first + k - center) / stretch));
+        }
+    }
+    return taps;
+}
+
+/*
+ * Resample the signed native order raster of a source to the output size
+ *
+ * The rows are filtered horizontally into a float raster by bands of input rows, then its
+ * columns vertically by bands of output rows. Only the vertical pass vectorizes, its inner
+ * loop runs over the contiguous samples of a row with one weight. The horizontal pass has
+ * a tap count of its own per output and stays scalar; filtering blocks of rows transposed
+ * to run it as a vertical pass measured no faster, the transposes costing what it saved.
+ * A void keeps no weight, an output is void where its nearest input is or no weight is left.
+ */
+void resample_raster(Source& source, Run& run) {
+    const Options& options = run.options;
+    const auto in_width = options.source_width;
+    const auto in_height = options.source_height;
+    const auto out_width = options.width;
+    const auto out_height = options.height;
+    const float none = -32768.0f;
+    const FilterTaps columns = make_filter_taps(options.filter, in_width, out_width);
+    const FilterTaps rows = make_filter_taps(options.filter, in_height, out_height);
+
+    std::vector<float> filtered(static_cast<std::size_t>(in_height) * out_width);
+    const std::int16_t* in = reinterpret_cast<const std::int16_t*>(source.raster.data());
+    run_bands(run, 0, in_height, [&](const int begin, const int end) {
+        for (auto y = begin; y < end; y++)
+        {
+            const std::int16_t* row = in + static_cast<std::size_t>(y) * in_width;
+            float* out = filtered.data() + static_cast<std::size_t>(y) * out_width;
+            for (auto x = 0; x < out_width; x++)
+            {
+                const float* weights = columns.weights.data() + static_cast<std::size_t>(x) * columns.stride;
+                const std::int16_t* taps = row + columns.first[x];
+                float sum = 0.0f;
+                float weight = 0.0f;
+                for (auto k = 0; k < columns.count[x]; k++)
+                {
+                    const float valid = taps[k] != -32768 ? weights[k] : 0.0f;
+                    sum += valid * taps[k];
+                    weight += valid;
+                }
+                out[x] = row[columns.nearest[x]] == -32768 || weight <= 0.0f ? none : sum / weight;
+            }
+        }
+    });
+
+    source.raster.resize(static_cast<std::size_t>(out_width) * out_height * sizeof(std::int16_t));
+    std::int16_t* out = reinterpret_cast<std::int16_t*>(source.raster.data());
+    run_bands(run, 0, out_height, [&](const int begin, const int end) {
+        std::vector<float> sums(out_width);
+        std::vector<float> weights(out_width);
+        for (auto y = begin; y < end; y++)
+        {
+            std::fill(sums.begin(), sums.end(), 0.0f);
+            std::fill(weights.begin(), weights.end(), 0.0f);
+            for (auto k = 0; k < rows.count[y]; k++)
+            {
+                const float w = rows.weights[static_cast<std::size_t>(y) * rows.stride + k];
+                const float* row = filtered.data() + static_cast<std::size_t>(rows.first[y] + k) * out_width;
+                for (auto x = 0; x < out_width; x++)
+                {
+                    const float valid = row[x] != none ? w : 0.0f;
+                    sums[x] += valid * row[x];
+                    weights[x] += valid;
+                }
+            }
+            const float* nearest = filtered.data() + static_cast<std::size_t>(rows.nearest[y]) * out_width;
+            std::int16_t* out_row = out + static_cast<std::size_t>(y) * out_width;
+            for (auto x = 0; x < out_width; x++)
+            {
+                const float value = std::min(32767.0f, std::max(-32767.0f, std::round(sums[x] / weights[x])));
+                out_row[x] = nearest[x] == none || weights[x] <= 0.0f ? -32768 : static_cast<std::int16_t>(value);
+            }
+        }
+    });
+    appendf(source.report, "Resized: %d x %d to %d x %d pixels, %s\n",
+        in_width, in_height, out_width, out_height, filter_names[static_cast<int>(options.filter)].name);
+}
+
+/*
+ * Read, verify and scan a HGT source, its samples are left signed in native order
+ *
+ * Returns false with 'source.error' set on failure, or with an empty error
+ * when the manifests of every output mode show the outputs are already up to date
+ */
+bool load_source(Source& source, Run& run) {
+    const Options& options = run.options;
+    const auto width = options.width;
+    const auto height = options.height;
+    const auto& schemes = options.schemes;
+    const char* hgt_filename = source.filename.c_str();
+    const std::string& base_name = source.base_name;
+    std::vector<std::uint8_t>& raster = source.raster;
+
+    /*
+     * Lay out the subtiles of every level and scheme, ordered by level
+     *
+     * Subtiles start every 'subwidth - overlap' columns and 'subheight - overlap' rows,
+     * the subtiles of the last row and column are truncated to the raster or padded with voids.
+     * Each overview keeps the subdivisions of the source,
+     * its subtiles cover the same ground at half the resolution of the level above
+     */
+    const auto overlap = options.overlap;
+    std::vector<std::size_t> scheme_first(schemes.size());
+    std::vector<Subtile>& subtiles = source.subtiles;
+    for (auto level = 0; level <= options.levels; level++)
+    {
+        const auto level_width = ((width - 1) >> level) + 1;
+        const auto level_height = ((height - 1) >> level) + 1;
+        source.levels.push_back({ level_width, level_height, 0, nullptr, PngCalibration() });
+        for (std::size_t s = 0; s < schemes.size(); s++)
+        {
+            const Scheme& scheme = schemes[s];
+            const auto level_subwidth = ((scheme.subwidth - 1) >> level) + 1;
+            const auto level_subheight = ((scheme.subheight - 1) >> level) + 1;
+            if (level == 0) scheme_first[s] = subtiles.size();
+            for (auto row_index = 0; row_index < scheme.rows; row_index++)
+            {
+                for (auto col_index = 0; col_index < scheme.cols; col_index++)
+                {
+                    const auto row_offset = row_index * (level_subheight - overlap);
+                    const auto col_offset = col_index * (level_subwidth - overlap);
+                    const bool partial = row_offset + level_subheight > level_height || col_offset + level_subwidth > level_width;
+                    subtiles.push_back({
+                        level, static_cast<int>(s), row_offset, col_offset,
+                        options.pad ? level_subwidth : std::min(level_subwidth, level_width - col_offset),
+                        options.pad ? level_subheight : std::min(level_subheight, level_height - row_offset),
+                        options.pad && partial ? std::numeric_limits<std::int16_t>::min() : std::numeric_limits<std::int16_t>::max(),
+                        std::numeric_limits<std::int16_t>::min(),
+                        0, 0
+                    });
+                }
+            }
+        }
+    }
+    source.overviews.resize(options.levels);
+
+    /*
+     * Select the subtiles within the region of interest,
+     * only the band of rows they span is read
+     */
+    int first_row = 0;
+    int last_row = height;
+    std::vector<bool> selected(subtiles.size(), true);
+    if (options.roi)
+    {
+        const char* last_slash = std::strrchr(hgt_filename, DIRECTORY_DELIM);
+        Location location;
+        parse_location(last_slash ? last_slash + 1 : hgt_filename, location);
+        first_row = height;
+        last_row = 0;
+        for (std::size_t index = 0; index < subtiles.size(); index++)
+        {
+            const Subtile& subtile = subtiles[index];
+            const int row_index = subtile.row_offset / (schemes[subtile.scheme].subheight - overlap);
+            const int col_index = subtile.col_offset / (schemes[subtile.scheme].subwidth - overlap);
+            const int end_row = std::min(subtile.row_offset + subtile.height, height);
+            const int end_col = std::min(subtile.col_offset + subtile.width, width);
+            if (options.bbox)
+            {
+                const double north = location.latitude + 1.0 - static_cast<double>(subtile.row_offset) / (height - 1);
+                const double south = north - static_cast<double>(end_row - 1 - subtile.row_offset) / (height - 1);
+                const double west = location.longitude + static_cast<double>(subtile.col_offset) / (width - 1);
+                const double east = west + static_cast<double>(end_col - 1 - subtile.col_offset) / (width - 1);
+                selected[index] =
+                    south <= options.bbox_north && north >= options.bbox_south &&
+                    west <= options.bbox_east && east >= options.bbox_west;
+            }
+            else
+            {
+                selected[index] = std::find(
+                    options.tiles.begin(), options.tiles.end(), std::make_pair(row_index, col_index)
+                ) != options.tiles.end();
+            }
+            if (!selected[index]) continue;
+            first_row = std::min(first_row, subtile.row_offset);
+            last_row = std::max(last_row, end_row);
+        }
+        if (first_row >= last_row)
+        {
+            appendf(source.report, "Region: no subtiles of \"%s\" selected, Skipping...\n", hgt_filename);
+            subtiles.clear();
+            source.empty = true;
+            return false;
+        }
+
+        /*
+         * The stencils of derived products reach a row past the subtiles
+         */
+        for (const auto& mode : options.modes)
+        {
+            if (mode.product == Product::Elevation) continue;
+            first_row = std::max(0, first_row - 1);
+            last_row = std::min(height, last_row + 1);
+            break;
+        }
+    }
+
+    /*
+     * A raster cached by a previous run in the same mode and range stands in for
+     * the read, swap, scan and conversion passes, the source is only verified
+     */
+    source.cached =
+        (options.shm && attach_shared_raster(source, options)) ||
+        (!options.cache.empty() && open_raster_cache(source, options));
+    source.levels[0].first_row = source.cached ? 0 : first_row;
+    const auto read_rows = options.resize ? options.source_height : last_row - first_row;
+    if (!read_source(source, options, first_row, source.cached ? 0 : read_rows)) return false;
+    if (source.cached && source.shared.ready_to_read())
+    {
+        appendf(source.report, "Shared: \"%s\"\n", source.shared.segment().c_str());
+    }
+    else if (source.cached)
+    {
+        appendf(source.report, "Cached: \"%s\"\n", raster_cache_name(options, source.filename).c_str());
+    }
+    const auto data_size = static_cast<std::int64_t>(raster.size());
+
+    /*
+     * Skip the source entirely if the manifest from a previous run of every output mode
+     * matches its content and settings and every output is still in place
+     */
+    const std::string manifest_name = base_name + ".manifest";
+    Manifest& manifest = source.manifest;
+    if ((options.manifest || !options.cache.empty() || options.shm || options.clip) && !options.roi)
+    {
+        manifest.source_hash = source.cached ? raster_cache_header(source).source_hash : hash64(raster.data(), raster.size());
+    }
+    if (options.manifest && !options.roi)
+    {
+        bool unchanged = true;
+        for (const auto& mode : options.modes)
+        {
+            const std::string mode_base_name = output_base_name(mode.prefix, source.filename);
+            Manifest previous;
+            unchanged = unchanged &&
+                read_manifest(mode_base_name + ".manifest", previous) &&
+                previous.source_hash == manifest.source_hash &&
+                previous.settings == manifest_settings(options, mode) &&
+                previous.tiles.size() == subtiles.size();
+            for (const auto& subtile : subtiles)
+            {
+                if (!unchanged) break;
+                const auto found = previous.tiles.find(subtile_name(subtile, options));
+                unchanged =
+                    found != previous.tiles.end() &&
+                    file_size((mode_base_name + "." + subtile_name(subtile, options) + ".png").c_str()) == found->second.png_size;
+            }
+        }
+        if (unchanged)
+        {
+            appendf(source.report, "Unchanged: \"%s\" matches \"%s\", Skipping...\n", hgt_filename, manifest_name.c_str());
+            subtiles.clear();
+            return false;
+        }
+    }
+    
+    /*
+     * Swap the byte order from Big to Little Endian
+     * if the platform is Little Endian
+     */
+    if (is_little_endian())
+    {
+        std::uint8_t swp = 0;
+        for (auto i = 0; i < data_size; i += sizeof(std::int16_t))
+        {
+            swp = raster[i];
+            raster[i] = raster[i+1];
+            raster[i+1] = swp;
+        }
+    }
+
+    /*
+     * Resample to the output size, the scan and everything after it see the resampled raster
+     */
+    if (options.resize && !source.cached) resample_raster(source, run);
+
+    /*
+     * Accumulate the range of the raster and of each subtile
+     *
+     * Each row is scanned in column segments, one per subtile column of every scheme.
+     * The columns a segment shares with the following subtile only count toward that
+     * subtile, the range of the raster is counted from the segments of the first scheme.
+     * A raster without a valid height has the empty range [0, 0].
+     */
+    int minimum = 32768;
+    int maximum = -32768;
+    int invalid = 0;
+    std::vector<std::int64_t> histogram(options.clip ? 65536 : 0);
+
+    const std::int16_t* svalue = reinterpret_cast<const std::int16_t*>(raster.data());
+    std::vector<std::int16_t> seg_min;
+    std::vector<std::int16_t> seg_max;
+    std::vector<std::uint64_t> seg_rough;
+    for (auto y = first_row; y < last_row && !source.cached; y++)
+    {
+        const std::int16_t* row = svalue + static_cast<std::size_t>(y - first_row) * width;
+        for (std::size_t s = 0; s < schemes.size(); s++)
+        {
+            const auto cols = schemes[s].cols;
+            const auto subwidth = schemes[s].subwidth;
+            const auto subheight = schemes[s].subheight;
+            const auto step_x = subwidth - overlap;
+            const auto step_y = subheight - overlap;
+            seg_min.resize(cols);
+            seg_max.resize(cols);
+            seg_rough.resize(cols);
+            for (auto col_index = 0; col_index < cols; col_index++)
+            {
+                const auto begin = col_index * step_x;
+                const auto own = col_index + 1 < cols ? begin + step_x : width;
+                const auto end = std::min(begin + subwidth, width);
+                std::int16_t lo = row[begin];
+                std::int16_t hi = row[begin];
+                std::int32_t prev = row[begin];
+                std::uint64_t rough = 0;
+                for (auto x = begin; x < own; x++)
+                {
+                    const std::int16_t temp = row[x];
+                    if (temp < lo) lo = temp;
+                    if (temp > hi) hi = temp;
+                    rough += static_cast<std::uint64_t>(std::abs(temp - prev));
+                    prev = temp;
+                    if (s > 0) continue;
+                    if (temp == -32768)
+                    {
+                        invalid++;
+                        continue;
+                    }
+                    if (temp < minimum) minimum = temp;
+                    if (temp > maximum) maximum = temp;
+                }
+                for (auto x = own; x < end; x++)
+                {
+                    const std::int16_t temp = row[x];
+                    if (temp < lo) lo = temp;
+                    if (temp > hi) hi = temp;
+                }
+                seg_min[col_index] = lo;
+                seg_max[col_index] = hi;
+                seg_rough[col_index] = rough;
+            }
+
+            /*
+             * Fold the segments into the subtile rows covering this row
+             */
+            const auto last_tile_row = std::min(y / step_y, schemes[s].rows - 1);
+            const auto first_tile_row = y < subheight ? 0 : (y - subheight) / step_y + 1;
+            for (auto col_index = 0; col_index < cols; col_index++)
+            {
+                const auto begin = col_index * step_x;
+                const auto end = std::min(begin + subwidth, width);
+                for (auto r = first_tile_row; r <= last_tile_row; r++)
+                {
+                    Subtile& subtile = subtiles[scheme_first[s] + static_cast<std::size_t>(r * cols + col_index)];
+                    if (seg_min[col_index] < subtile.minimum) subtile.minimum = seg_min[col_index];
+                    if (seg_max[col_index] > subtile.maximum) subtile.maximum = seg_max[col_index];
+                    subtile.roughness += seg_rough[col_index];
+                    if (options.manifest)
+                    {
+                        subtile.source_hash = hash64(
+                            row + begin, static_cast<std::size_t>(end - begin) * sizeof(std::int16_t), subtile.source_hash
+                        );
+                    }
+                }
+            }
+        }
+    }
+
+    /*
+     * Clipping counts the heights into a histogram in a second pass over the raster, each
+     * band of rows into bins of its own merged once the band is done. The scan above stays
+     * serial on the reader thread, as the hashes of the subtiles chain their rows in order.
+     */
+    if (options.clip && !source.cached)
+    {
+        std::mutex merge_lock;
+        run_bands(run, 0, last_row - first_row, [&](const int begin, const int end) {
+            std::vector<std::int64_t> bins(65536);
+            const auto band_end = static_cast<std::size_t>(end) * width;
+            for (auto i = static_cast<std::size_t>(begin) * width; i < band_end; i++) bins[static_cast<std::uint16_t>(svalue[i])]++;
+            std::lock_guard<std::mutex> guard(merge_lock);
+            for (std::size_t value = 0; value < bins.size(); value++) histogram[value] += bins[value];
+        });
+    }
+    if (source.cached)
+    {
+        minimum = raster_cache_header(source).minimum;
+        maximum = raster_cache_header(source).maximum;
+        invalid = static_cast<int>(raster_cache_header(source).voids);
+    }
+    if (minimum > maximum) minimum = maximum = 0;
+    source.voids = invalid;
+    appendf(source.report, "Range: [%d, %d] meters\nMissing: %d pixels\n", minimum, maximum, invalid);
+
+    /*
+     * Clipping calibrates with the percentiles of the histogram counted by the scan, heights
+     * outside them saturate. The histogram of a whole source is kept in its statistics sidecar,
+     * unless it was resampled and no longer counts the samples of the source.
+     */
+    if (options.clip && !source.cached)
+    {
+        minimum = histogram_percentile(histogram, options.clip_low);
+        maximum = histogram_percentile(histogram, options.clip_high);
+        appendf(source.report, "Clip: [%d, %d] meters at percentiles %g and %g\n", minimum, maximum, options.clip_low, options.clip_high);
+        if (!options.roi && !options.resize)
+        {
+            SourceStats stats;
+            stats.size = file_size(hgt_filename);
+            stats.modified = file_time(hgt_filename);
+            stats.source_hash = manifest.source_hash;
+            stats.voids = invalid;
+            for (auto value = -32767; value <= 32767; value++)
+            {
+                const auto count = histogram[static_cast<std::uint16_t>(value)];
+                if (count == 0) continue;
+                stats.histogram[value] = count;
+                stats.minimum = std::min(stats.minimum, value);
+                stats.maximum = std::max(stats.maximum, value);
+            }
+            if (!write_stats(base_name + ".stats", stats)) appendf(source.report, "Could not write statistics \"%s.stats\"\n", base_name.c_str());
+        }
+    }
+
+    /*
+     * A region only scans the rows it spans. The whole source range is preferred over that
+     * local range, from the statistics sidecar while it matches the size and modification
+     * time of the source, or else from the manifest of a previous run with the same settings
+     * whose hashes match those of the subtiles in the region.
+     */
+    if (options.global_range)
+    {
+        minimum = options.global_minimum;
+        maximum = options.global_maximum;
+        appendf(source.report, "Range: [%d, %d] meters, global\n", minimum, maximum);
+    }
+    if (options.roi && !options.global_range && !source.cached)
+    {
+        SourceStats stats;
+        Manifest cached;
+        bool matches = false;
+        if (read_stats(base_name + ".stats", stats) && stats.size == file_size(hgt_filename) && stats.modified == file_time(hgt_filename))
+        {
+            const auto whole = stats_histogram(stats);
+            minimum = options.clip ? histogram_percentile(whole, options.clip_low) : stats.minimum;
+            maximum = options.clip ? histogram_percentile(whole, options.clip_high) : stats.maximum;
+            appendf(source.report, "Range: [%d, %d] meters, gathered in \"%s.stats\"\n", minimum, maximum, base_name.c_str());
+        }
+        else if (options.manifest && read_manifest(manifest_name, cached) &&
+                 cached.settings == manifest_settings(options, { options.absolute, options.product, options.prefix }))
+        {
+            matches = true;
+            for (std::size_t index = 0; index < subtiles.size() && matches; index++)
+            {
+                if (!selected[index] || subtiles[index].level > 0) continue;
+                const auto found = cached.tiles.find(subtile_name(subtiles[index], options));
+                matches = found != cached.tiles.end() && found->second.source_hash == subtiles[index].source_hash;
+            }
+        }
+        if (matches)
+        {
+            minimum = cached.minimum;
+            maximum = cached.maximum;
+            appendf(source.report, "Range: [%d, %d] meters, cached in \"%s\"\n", minimum, maximum, manifest_name.c_str());
+        }
+    }
+    if (options.roi)
+    {
+
+        std::size_t kept = 0;
+        for (std::size_t index = 0; index < subtiles.size(); index++)
+        {
+            if (selected[index]) subtiles[kept++] = subtiles[index];
+        }
+        appendf(source.report, "Region: %zu of %zu subtiles, rows %d to %d\n", kept, subtiles.size(), first_row, last_row - 1);
+        subtiles.resize(kept);
+    }
+    source.outputs.resize(subtiles.size());
+    manifest.minimum = minimum;
+    manifest.maximum = maximum;
+
+    /*
+     * The filters of an overview reach into the neighbouring subtiles,
+     * so an overview subtile hashes the source hashes of the 3x3 subtiles around it
+     */
+    if (options.manifest)
+    {
+        const auto per_level = subtiles.size() / static_cast<std::size_t>(options.levels + 1);
+        for (std::size_t index = per_level; index < subtiles.size(); index++)
+        {
+            const Scheme& scheme = schemes[subtiles[index].scheme];
+            const auto first = scheme_first[subtiles[index].scheme];
+            const auto row_index = static_cast<int>(index % per_level - first) / scheme.cols;
+            const auto col_index = static_cast<int>(index % per_level - first) % scheme.cols;
+            std::uint64_t hash = hash64(&subtiles[index].level, sizeof(int));
+            for (auto r = std::max(0, row_index - 1); r <= std::min(scheme.rows - 1, row_index + 1); r++)
+            {
+                for (auto c = std::max(0, col_index - 1); c <= std::min(scheme.cols - 1, col_index + 1); c++)
+                {
+                    hash = hash64(&subtiles[first + static_cast<std::size_t>(r * scheme.cols + c)].source_hash, sizeof(std::uint64_t), hash);
+                }
+            }
+            subtiles[index].source_hash = hash;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * Convert a loaded source to unsigned 16 bit in the output mode of 'options'
+ *
+ * The raster of a derived product already holds its pixels, only its calibration is set
+ */
+void convert_raster(Source& source, const Options& options) {
+    const bool absolute = options.absolute;
+    const bool elevation = options.product == Product::Elevation;
+    Manifest& previous = source.previous;
+    Manifest& manifest = source.manifest;
+    source.absolute = absolute;
+    source.product = options.product;
+    source.format = product_format(options, options.product);
+
+    /*
+     * Subtiles of the previous run may only be reused when the
+     * settings and the range, which sets the calibration, are unchanged.
+     * The subtiles of a cached raster are not scanned, so have no hashes to compare, and the
+     * pixels of a derived product or of a filled void depend on the samples around their subtile.
+     */
+    if (options.manifest && !options.roi)
+    {
+        manifest.settings = manifest_settings(options, { absolute, options.product, options.prefix });
+        read_manifest(source.base_name + ".manifest", previous);
+    }
+    source.reusable =
+        options.manifest && !options.roi && !source.cached && elevation && !source.filled &&
+        previous.settings == manifest.settings &&
+        previous.minimum == manifest.minimum &&
+        previous.maximum == manifest.maximum;
+
+    /*
+     * The range of the heights sets the calibration of the elevation modes
+     */
+    const double minf = elevation ? static_cast<double>(manifest.minimum) : find_product(options.product)->minf;
+    const double deltaf = elevation ? static_cast<double>(manifest.maximum) - minf : find_product(options.product)->deltaf;
+
+    /*
+     * Convert the raster to unsigned 16 bit
+     *
+     * Absolute Mode ('a') offsets the heights by 32767
+     *
+     * Relative Mode, By default('r'), scales the raster to the range such that
+     * the minimum height encodes to 0 and the maximum height encodes to 65534
+     *
+     * A raster this process shares is converted straight into the shared segment
+     */
+    const auto pixel_count = elevation ? source.raster.size() / sizeof(std::int16_t) : 0;
+    const std::int16_t* svalue = reinterpret_cast<const std::int16_t*>(source.raster.data());
+    std::uint8_t* converted = source.shared.creating() ? source.shared.data() + sizeof(RasterCacheHeader) : source.raster.data();
+    std::uint16_t* uvalue = reinterpret_cast<std::uint16_t*>(converted);
+    for (std::size_t i = 0; i < pixel_count; i++)
+    {
+        uvalue[i] = absolute ? to_absolute(svalue[i]) : to_relative(svalue[i], minf, deltaf);
+    }
+
+    for (auto& level : source.levels)
+    {
+        level.calibration.minf = minf;
+        level.calibration.deltaf = deltaf;
+    }
+    source.levels[0].data = source.cached ?
+        reinterpret_cast<const std::uint8_t*>(&raster_cache_header(source) + 1) : converted;
+}
+
+/*
+ * A source read by the reader thread is waiting until its first subtile encodes,
+ * the reader reads the next source once fewer than 'prefetch' are waiting
+ */
+void start_source(Source& source, Run& run) {
+    if (source.derived || source.started.exchange(true)) return;
+    {
+        std::lock_guard<std::mutex> guard(run.lock);
+        run.waiting--;
+    }
+    run.read_ahead.notify_one();
+}
+
+/*
+ * Report a source, record its manifest and release its raster
+ */
+void finish_source(Source& source, Run& run) {
+    start_source(source, run);
+    const auto subtile_count = static_cast<int>(source.subtiles.size());
+    if (source.error.empty() && subtile_count > 0)
+    {
+        for (auto i = 0; i < subtile_count; i++)
+        {
+            source.manifest.tiles[subtile_name(source.subtiles[i], run.options)] = source.outputs[i];
+        }
+        const std::string manifest_name = source.base_name + ".manifest";
+        if (run.options.manifest && !run.options.roi && !write_manifest(manifest_name, source.manifest))
+        {
+            appendf(source.error, "Could not write manifest \"%s\"", manifest_name.c_str());
+        }
+    }
+
+    /*
+     * Show some statistics
+     */
+    if (source.error.empty() && subtile_count > 0)
+    {
+        appendf(source.report, "Constant: %d of %d subtiles\n", source.constant_count.load(), subtile_count);
+        if (run.options.manifest)
+        {
+            appendf(source.report, "Unchanged: %d of %d subtiles\n", source.unchanged_count.load(), subtile_count);
+        }
+        appendf(source.report, "Output: Compression: %.2lf%% of original size\n",
+            static_cast<double>(source.png_size.load()) / static_cast<double>(source.size) * 100.0
+        );
+        if (!source.derived) run.converted++;
+        run.subtiles += subtile_count;
+        run.png_bytes += static_cast<std::int64_t>(source.png_size.load());
+    }
+    else if (source.error.empty())
+    {
+        if (source.empty) run.empty++;
+        else run.skipped++;
+    }
+    if (!source.derived) run.source_bytes += source.size;
+
+    std::lock_guard<std::mutex> guard(run.lock);
+    if (!source.error.empty())
+    {
+        appendf(source.report, "%s, Skipping...\n", source.error.c_str());
+        run.failures.push_back(source.filename + ": " + source.error);
+    }
+    std::fputs(source.report.c_str(), stdout);
+    std::fflush(stdout);
+    run.buffers->release(std::move(source.raster));
+    std::vector<std::vector<std::uint16_t>>().swap(source.overviews);
+    if (!source.derived)
+    {
+        run.in_flight--;
+        run.read_ahead.notify_one();
+    }
+}
+
+/*
+ * Encode and write one subtile of a loaded source
+ */
+void encode_subtile(Source& source, const std::size_t index, Run& run) {
+    const Options& options = run.options;
+    const Subtile& subtile = source.subtiles[index];
+    const Level& level = source.levels[subtile.level];
+    const auto subwidth = subtile.width;
+    const auto subheight = subtile.height;
+    std::vector<std::uint8_t> png_data;
+    const std::vector<std::uint8_t>* encoded = &png_data;
+    const std::string subname = subtile_path(source, subtile, options);
+
+    /*
+     * Keep the output of the previous run if the source rows of the subtile are unchanged
+     */
+    if (source.reusable)
+    {
+        const auto found = source.previous.tiles.find(subtile_name(subtile, options));
+        if (found != source.previous.tiles.end() &&
+            found->second.source_hash == subtile.source_hash &&
+            file_size(subname.c_str()) == found->second.png_size)
+        {
+            source.outputs[index] = found->second;
+            source.png_size += static_cast<std::size_t>(found->second.png_size);
+            source.unchanged_count++;
+            return;
+        }
+    }
+
+    /*
+     * Setup a vector of pointers to the beginning of each row
+     *
+     * Rows of a padded edge subtile are copied into a buffer filled with voids, 0xFFFF in
+     * 16 bit and 0 in 8 bit, each row rounded up to a multiple of 32 bytes. The vector only
+     * guarantees the alignment of max_align_t, so the rows start at the first 32 byte boundary
+     * within 31 spare bytes and every row starts aligned
+     */
+    const auto pixel_size = static_cast<std::size_t>(source.format.pixel_size());
+    std::vector<std::uint8_t*> png_rows(subheight);
+    std::vector<std::uint8_t> padded;
+    const auto inside_width = std::min(subwidth, level.width - subtile.col_offset);
+    const auto inside_height = std::min(subheight, level.height - subtile.row_offset);
+    if (inside_width < subwidth || inside_height < subheight)
+    {
+        const auto stride = (pixel_size * subwidth + 31) & ~static_cast<std::size_t>(31);
+        padded.assign(stride * subheight + 31, source.format.depth == 16 ? 0xFF : 0x00);
+        void* aligned = padded.data();
+        std::size_t space = padded.size();
+        std::uint8_t* padded_rows = static_cast<std::uint8_t*>(std::align(32, stride * subheight, aligned, space));
+        for (auto y = 0; y < subheight; y++)
+        {
+            std::uint8_t* padded_row = padded_rows + stride * y;
+            if (y < inside_height)
+            {
+                const std::uint8_t* row = level.data + pixel_size *
+                    (static_cast<std::size_t>(subtile.row_offset + y - level.first_row) * level.width + subtile.col_offset);
+                std::copy(row, row + pixel_size * inside_width, padded_row);
+            }
+            png_rows[y] = padded_row;
+        }
+    }
+    else
+    {
+        for (auto row_abs = subtile.row_offset; row_abs < (subtile.row_offset + subheight); row_abs++)
+        {
+            png_rows[row_abs - subtile.row_offset] = const_cast<std::uint8_t*>(level.data + pixel_size *
+                (static_cast<std::size_t>(row_abs - level.first_row) * level.width + subtile.col_offset)
+            );
+        }
+    }
+
+    /*
+     * Calculate the physical dimensions of the subraster in radians
+     */
+    const Scheme& scheme = options.schemes[subtile.scheme];
+    PngCalibration cal = level.calibration;
+    cal.upx = deg_to_rad(1.0 / static_cast<double>((scheme.subwidth - 1) >> subtile.level));
+    cal.upy = deg_to_rad(1.0 / static_cast<double>((scheme.subheight - 1) >> subtile.level));
+
+    /*
+     * Constant subtiles skip the filter and deflate passes
+     *
+     * Overview subtiles and those of cached rasters are not scanned, their minimum is above
+     * their maximum, and the range of heights says nothing of a derived product.
+     * Checking them stops at their first differing pixel
+     */
+    const bool elevation = source.product == Product::Elevation;
+    bool constant = elevation && subtile.minimum == subtile.maximum;
+    std::uint16_t value = 0;
+    const std::uint8_t* pixel = reinterpret_cast<const std::uint8_t*>(&value);
+    if (constant)
+    {
+        value = source.absolute ? to_absolute(subtile.minimum) : to_relative(subtile.minimum, cal.minf, cal.deltaf);
+    }
+    else if (!elevation || subtile.minimum > subtile.maximum)
+    {
+        /*
+         * The first row is constant when it matches itself shifted by a pixel, the others must match it
+         */
+        const auto row_size = pixel_size * subwidth;
+        pixel = png_rows[0];
+        constant = std::memcmp(png_rows[0], png_rows[0] + pixel_size, row_size - pixel_size) == 0;
+        for (auto y = 1; y < subheight && constant; y++) constant = std::memcmp(png_rows[y], png_rows[0], row_size) == 0;
+    }
+
+    if (constant)
+    {
+        encoded = &run.constants.get(subwidth, subheight, pixel, cal, source.format);
+        source.constant_count++;
+    }
+    else
+    {
+        encode_png(png_data, subwidth, subheight, cal, png_rows.data(), source.format);
+    }
+    const auto png_size = encoded->size();
+
+    /*
+     * Write the PNG buffer out to file
+     */
+    CFile png_file = CFile(std::fopen(subname.c_str(), "wb"), [](FILE* f)->void { std::fclose(f); });
+    const auto write_size = png_file.get() ? std::fwrite(encoded->data(), png_size, 1, png_file.get()) : 0;
+
+    /*
+     * Verify the file write
+     */
+    if (write_size != 1)
+    {
+        std::lock_guard<std::mutex> guard(source.lock);
+        if (source.error.empty())
+        {
+            if (!png_file.get()) appendf(source.error, "Could not open file \"%s\"", subname.c_str());
+            else appendf(source.error, "Write size %zu, Expected 1", write_size);
+        }
+        return;
+    }
+
+    if (options.manifest)
+    {
+        source.outputs[index] = { subtile.source_hash, hash64(encoded->data(), png_size), static_cast<std::int64_t>(png_size) };
+    }
+    source.png_size += png_size;
+}
+
+/*
+ * Schedule the subtiles of a converted source on the run's pool
+ *
+ * Each overview level is reduced from the level above while the subtiles
+ * of the levels already scheduled encode
+ */
+void schedule_source(const std::shared_ptr<Source>& source, Run& run) {
+    source->remaining = static_cast<int>(source->subtiles.size());
+    std::size_t index = 0;
+    for (auto level = 0; level <= run.options.levels; level++)
+    {
+        if (level > 0)
+        {
+            const Level& above = source->levels[level - 1];
+            Level& current = source->levels[level];
+            auto& overview = source->overviews[level - 1];
+            overview.resize(static_cast<std::size_t>(current.width) * current.height);
+            reduce_raster(reinterpret_cast<const std::uint16_t*>(above.data), above.width, above.height, overview.data());
+            current.data = reinterpret_cast<const std::uint8_t*>(overview.data());
+        }
+
+        /*
+         * Predict the cost of each subtile from its roughness,
+         * constant subtiles come from the cache at next to no cost
+         */
+        std::vector<Task> tasks;
+        for (; index < source->subtiles.size() && source->subtiles[index].level == level; index++)
+        {
+            const Subtile& subtile = source->subtiles[index];
+            const auto pixels = static_cast<std::uint64_t>(subtile.width) * subtile.height;
+            const bool constant = subtile.minimum == subtile.maximum;
+            tasks.push_back({ constant ? 1 : pixels + subtile.roughness, [source, index, &run]() {
+                start_source(*source, run);
+                encode_subtile(*source, index, run);
+                if (--source->remaining == 0) finish_source(*source, run);
+            }});
+        }
+        run.pool->submit(std::move(tasks));
+    }
+}
+
+/*
+ * Fill the voids of a loaded source from the valid samples around them
+ *
+ * Each void takes the inverse distance weighted mean of the first valid sample along each
+ * of the 8 directions, searched up to 'fill' pixels away. Voids with none in reach stay void.
+ * The fills are found from the unfilled heights in bands of rows, rows without voids cost
+ * a single scan, and written once every band is done. Subtiles that held voids are
+ * marked as not scanned, so whether they are constant is checked from their pixels.
+ */
+void fill_voids(Source& source, Run& run) {
+    const auto width = run.options.width;
+    const auto reach = run.options.fill;
+    const auto rows = static_cast<int>(source.raster.size() / sizeof(std::int16_t) / width);
+    std::int16_t* heights = reinterpret_cast<std::int16_t*>(source.raster.data());
+    const int directions[8][2] = { { 1, 0 }, { -1, 0 }, { 0, 1 }, { 0, -1 }, { 1, 1 }, { 1, -1 }, { -1, 1 }, { -1, -1 } };
+
+    std::vector<std::pair<std::size_t, std::int16_t>> fills;
+    std::mutex lock;
+    run_bands(run, 0, rows, [&](const int begin, const int end) {
+        std::vector<std::pair<std::size_t, std::int16_t>> band_fills;
+        for (auto y = begin; y < end; y++)
+        {
+            const std::int16_t* row = heights + static_cast<std::size_t>(y) * width;
+            for (auto x = static_cast<int>(std::find(row, row + width, -32768) - row); x < width; x++)
+            {
+                if (row[x] != -32768) continue;
+                double sum = 0.0;
+                double weights = 0.0;
+                for (const auto& direction : directions)
+                {
+                    for (auto step = 1; step <= reach; step++)
+                    {
+                        const auto sx = x + direction[0] * step;
+                        const auto sy = y + direction[1] * step;
+                        if (sx < 0 || sx >= width || sy < 0 || sy >= rows) break;
+                        const std::int16_t sample = heights[static_cast<std::size_t>(sy) * width + sx];
+                        if (sample == -32768) continue;
+                        const double weight = 1.0 / (static_cast<double>(step) * step * (direction[0] && direction[1] ? 2.0 : 1.0));
+                        sum += weight * sample;
+                        weights += weight;
+                        break;
+                    }
+                }
+                if (weights > 0.0)
+                {
+                    band_fills.push_back({ static_cast<std::size_t>(y) * width + x, static_cast<std::int16_t>(std::lround(sum / weights)) });
+                }
+            }
+        }
+        std::lock_guard<std::mutex> guard(lock);
+        fills.insert(fills.end(), band_fills.begin(), band_fills.end());
+    });
+
+    for (const auto& fill : fills) heights[fill.first] = fill.second;
+    for (auto& subtile : source.subtiles)
+    {
+        if (subtile.minimum != -32768) continue;
+        subtile.minimum = std::numeric_limits<std::int16_t>::max();
+        subtile.maximum = std::numeric_limits<std::int16_t>::min();
+    }
+    appendf(source.report, "Filled: %zu of %" PRId64 " missing pixels\n", fills.size(), source.voids);
+    source.voids -= static_cast<std::int64_t>(fills.size());
+    source.filled = !fills.empty();
+}
+
+/*
+ * Trace the contour lines of a loaded source every 'contours' meters into
+ * <Output Prefix><SOURCE>.contours.geojson
+ *
+ * Marching squares runs over the cells between the signed heights in bands of rows,
+ * each crossing a level between the lowest and highest corner of a cell, saddles
+ * resolved by the mean of the corners, cells with a void corner skipped. A segment
+ * ends on two cell edges, and every edge is shared by the two cells either side, so
+ * sorting the segment ends by (level, edge) pairs the segments to join, within a band
+ * and across band boundaries alike. The joined lines are placed from the bounds.
+ */
+struct ContourSegment {
+    std::uint64_t ends[2];
+};
+
+bool trace_contours(Source& source, Run& run) {
+    const auto width = run.options.width;
+    const auto height = run.options.height;
+    const auto interval = run.options.contours;
+    const auto first_row = source.levels[0].first_row;
+    const auto rows = static_cast<int>(source.raster.size() / sizeof(std::int16_t) / width);
+    const std::int16_t* heights = reinterpret_cast<const std::int16_t*>(source.raster.data());
+    const auto edges = 2 * static_cast<std::uint64_t>(width) * rows;
+    const auto floor_div = [interval](const int value) { return value >= 0 ? value / interval : -((-value + interval - 1) / interval); };
+
+    /*
+     * Levels are keyed from the lowest height a sample can hold, not the calibrated minimum,
+     * which clipping or a cached range may place above heights of the raster
+     */
+    const auto base_level = floor_div(-32767);
+
+    /*
+     * Edge (x, y) is the horizontal edge right of sample (x, y) when even and the vertical edge below it when odd
+     */
+    std::map<int, std::vector<ContourSegment>> bands;
+    std::mutex lock;
+    run_bands(run, 0, rows - 1, [&](const int begin, const int end) {
+        std::vector<ContourSegment> segments;
+        for (auto y = begin; y < end; y++)
+        {
+            const std::int16_t* top = heights + static_cast<std::size_t>(y) * width;
+            const std::int16_t* bottom = top + width;
+            for (auto x = 0; x + 1 < width; x++)
+            {
+                const int tl = top[x];
+                const int tr = top[x + 1];
+                const int br = bottom[x + 1];
+                const int bl = bottom[x];
+                if (tl == -32768 || tr == -32768 || br == -32768 || bl == -32768) continue;
+                const auto low = std::min(std::min(tl, tr), std::min(br, bl));
+                const auto high = std::max(std::max(tl, tr), std::max(br, bl));
+                const auto cell = 2 * (static_cast<std::uint64_t>(y) * width + x);
+                const std::uint64_t side[4] = { cell, cell + 2 * width, cell + 1, cell + 3 };
+                enum { top_edge, bottom_edge, left_edge, right_edge };
+                for (auto k = floor_div(low) + 1; k <= floor_div(high); k++)
+                {
+                    const auto level = k * interval;
+                    const auto key = static_cast<std::uint64_t>(k - base_level) * edges;
+                    const auto add = [&](const int a, const int b) { segments.push_back({ { key + side[a], key + side[b] } }); };
+                    const bool centre = (tl + tr + br + bl) >= 4 * level;
+                    switch ((tl >= level ? 8 : 0) | (tr >= level ? 4 : 0) | (br >= level ? 2 : 0) | (bl >= level ? 1 : 0))
+                    {
+                    case 1: case 14: add(left_edge, bottom_edge); break;
+                    case 2: case 13: add(bottom_edge, right_edge); break;
+                    case 3: case 12: add(left_edge, right_edge); break;
+                    case 4: case 11: add(top_edge, right_edge); break;
+                    case 6: case 9: add(top_edge, bottom_edge); break;
+                    case 7: case 8: add(left_edge, top_edge); break;
+                    case 5:
+                        if (centre) { add(left_edge, top_edge); add(bottom_edge, right_edge); }
+                        else { add(left_edge, bottom_edge); add(top_edge, right_edge); }
+                        break;
+                    case 10:
+                        if (centre) { add(top_edge, right_edge); add(left_edge, bottom_edge); }
+                        else { add(left_edge, top_edge); add(bottom_edge, right_edge); }
+                        break;
+                    }
+                }
+            }
+        }
+        std::lock_guard<std::mutex> guard(lock);
+        bands[begin] = std::move(segments);
+    });
+    std::vector<ContourSegment> segments;
+    for (auto& band : bands) segments.insert(segments.end(), band.second.begin(), band.second.end());
+
+    /*
+     * Pair the ends sharing a (level, edge), 'link' holds the end each end joins or -1
+     */
+    std::vector<std::pair<std::uint64_t, std::int64_t>> ends;
+    ends.reserve(2 * segments.size());
+    for (std::size_t i = 0; i < segments.size(); i++)
+    {
+        ends.push_back({ segments[i].ends[0], static_cast<std::int64_t>(2 * i) });
+        ends.push_back({ segments[i].ends[1], static_cast<std::int64_t>(2 * i + 1) });
+    }
+    std::sort(ends.begin(), ends.end());
+    std::vector<std::int64_t> link(ends.size(), -1);
+    for (std::size_t i = 0; i + 1 < ends.size(); i++)
+    {
+        if (ends[i].first != ends[i + 1].first) continue;
+        link[ends[i].second] = ends[i + 1].second;
+        link[ends[i + 1].second] = ends[i].second;
+        i++;
+    }
+
+    /*
+     * The position of a crossing, interpolated along its edge
+     */
+    const double south = source.latitude;
+    const double west = source.longitude;
+    std::string json = "{\"type\":\"FeatureCollection\",\"features\":[";
+    const auto point = [&](const std::uint64_t key, const bool first) {
+        const auto level = static_cast<double>((static_cast<int>(key / edges) + base_level) * interval);
+        const auto edge = key % edges;
+        const auto sample = edge / 2;
+        const auto x = static_cast<int>(sample % width);
+        const auto y = static_cast<int>(sample / width);
+        const auto next = edge % 2 ? sample + width : sample + 1;
+        const double z0 = heights[sample];
+        const double t = (level - z0) / (heights[next] - z0);
+        appendf(json, "%s[%.7f,%.7f]", first ? "" : ",",
+            west + (x + (edge % 2 ? 0.0 : t)) / (width - 1),
+            south + 1.0 - (first_row + y + (edge % 2 ? t : 0.0)) / (height - 1)
+        );
+    };
+
+    /*
+     * Walk each line from one of its open ends, a ring from any of its segments
+     */
+    std::vector<bool> visited(segments.size(), false);
+    std::size_t lines = 0;
+    for (std::size_t i = 0; i < segments.size(); i++)
+    {
+        if (visited[i]) continue;
+        auto start = static_cast<std::int64_t>(2 * i);
+        for (auto end = link[start]; end >= 0 && static_cast<std::size_t>(end / 2) != i; end = link[start]) start = end ^ 1;
+
+        const auto key = segments[static_cast<std::size_t>(start / 2)].ends[start % 2];
+        appendf(json, "%s{\"type\":\"Feature\",\"properties\":{\"elevation\":%d},\"geometry\":{\"type\":\"LineString\",\"coordinates\":[",
+            lines++ ? "," : "", (static_cast<int>(key / edges) + base_level) * interval
+        );
+        point(key, true);
+        for (auto end = start; end >= 0 && !visited[static_cast<std::size_t>(end / 2)]; end = link[end ^ 1])
+        {
+            visited[static_cast<std::size_t>(end / 2)] = true;
+            point(segments[static_cast<std::size_t>(end / 2)].ends[(end ^ 1) % 2], false);
+        }
+        json += "]}}";
+    }
+    json += "]}\n";
+
+    const std::string contour_name = source.base_name + ".contours.geojson";
+    CFile contour_file = CFile(std::fopen(contour_name.c_str(), "wb"), [](FILE* f)->void { std::fclose(f); });
+    if (!contour_file.get() || std::fwrite(json.data(), json.size(), 1, contour_file.get()) != 1)
+    {
+        appendf(source.error, "Could not write contours \"%s\"", contour_name.c_str());
+        return false;
+    }
+    appendf(source.report, "Contours: %zu lines every %d meters in \"%s\"\n", lines, interval, contour_name.c_str());
+    return true;
+}
+
+/*
+ * Right-Triangulated Irregular Network
+ *
+ * A grid of 2^k + 1 samples a side splits into two right triangles, each of which
+ * splits in halves down to single cells, triangle i of the heap numbered from id i + 2.
+ * The error of a split, how far its midpoint lies from the mean of its hypotenuse, is
+ * folded into the midpoint from those of both children, so extracting every triangle
+ * whose midpoint error exceeds the maximum refines its neighbours too and leaves no cracks.
+ * A split touching a void always refines, voids end up in triangles of single cells.
+ */
+void rtin_errors(const std::vector<float>& terrain, const int size, std::vector<float>& errors) {
+    const float none = -32768.0f;
+    const auto tile_size = size - 1;
+    const auto triangles = tile_size * tile_size * 2 - 2;
+    const auto parents = triangles - tile_size * tile_size;
+    errors.assign(terrain.size(), 0.0f);
+    for (auto i = triangles - 1; i >= 0; i--)
+    {
+        auto id = i + 2;
+        int ax = 0, ay = 0, bx = 0, by = 0, cx = 0, cy = 0;
+        if (id & 1) bx = by = cx = tile_size;
+        else ax = ay = cy = tile_size;
+        while ((id >>= 1) > 1)
+        {
+            const auto mx = (ax + bx) >> 1;
+            const auto my = (ay + by) >> 1;
+            if (id & 1)
+            {
+                bx = ax; by = ay;
+                ax = cx; ay = cy;
+            }
+            else
+            {
+                ax = bx; ay = by;
+                bx = cx; by = cy;
+            }
+            cx = mx; cy = my;
+        }
+
+        const auto mx = (ax + bx) >> 1;
+        const auto my = (ay + by) >> 1;
+        const float a = terrain[static_cast<std::size_t>(ay) * size + ax];
+        const float b = terrain[static_cast<std::size_t>(by) * size + bx];
+        const auto middle = static_cast<std::size_t>(my) * size + mx;
+        const float error = a == none || b == none || terrain[middle] == none ?
+            std::numeric_limits<float>::max() : std::fabs((a + b) / 2.0f - terrain[middle]);
+        errors[middle] = std::max(errors[middle], error);
+        if (i >= parents) continue;
+        const auto left = static_cast<std::size_t>((ay + cy) >> 1) * size + ((ax + cx) >> 1);
+        const auto right = static_cast<std::size_t>((by + cy) >> 1) * size + ((bx + cx) >> 1);
+        errors[middle] = std::max(errors[middle], std::max(errors[left], errors[right]));
+    }
+}
+
+struct RtinMesh {
+    int size;
+    float max_error;
+    const std::vector<float>* errors;
+    std::vector<std::uint32_t> indices;
+    std::vector<std::uint16_t> vertices;
+    std::vector<std::uint32_t> triangles;
+
+    std::uint32_t vertex(const int x, const int y) {
+        std::uint32_t& index = indices[static_cast<std::size_t>(y) * size + x];
+        if (index == 0)
+        {
+            vertices.push_back(static_cast<std::uint16_t>(x));
+            vertices.push_back(static_cast<std::uint16_t>(y));
+            index = static_cast<std::uint32_t>(vertices.size() / 2);
+        }
+        return index - 1;
+    }
+
+    void extract(const int ax, const int ay, const int bx, const int by, const int cx, const int cy) {
+        const auto mx = (ax + bx) >> 1;
+        const auto my = (ay + by) >> 1;
+        if (std::abs(ax - cx) + std::abs(ay - cy) > 1 && (*errors)[static_cast<std::size_t>(my) * size + mx] > max_error)
+        {
+            extract(cx, cy, ax, ay, mx, my);
+            extract(bx, by, cx, cy, mx, my);
+            return;
+        }
+        triangles.push_back(vertex(ax, ay));
+        triangles.push_back(vertex(bx, by));
+        triangles.push_back(vertex(cx, cy));
+    }
+};
+
+void append_le(std::vector<std::uint8_t>& out, const std::uint64_t value, const int bytes) {
+    for (auto i = 0; i < bytes; i++) out.push_back(static_cast<std::uint8_t>(value >> (8 * i)));
+}
+
+/*
+ * Write the mesh of every subtile of a loaded source, split wherever a midpoint errs by more
+ * than 'mesh_error' meters, into <Output Prefix><SOURCE>.<Row>.<Col>.mesh
+ *
+ * The errors of the subtiles are built in bands of subtiles. A mesh is little endian,
+ * a 64 byte header of
+ *   "HGT2PNGM", version 1, vertex count, triangle count, samples a side (uint32 each),
+ *   maximum error (float), lowest and highest vertex height (int16 each) and
+ *   west, south, east and north in degrees (double each),
+ * then every vertex as its column and row in the subtile and its height (int16, voids -32768),
+ * then every triangle as 3 vertex indices (uint32 each). Truncated subtiles are not square
+ * and are skipped.
+ */
+bool build_meshes(Source& source, Run& run) {
+    const Options& options = run.options;
+    const auto width = options.width;
+    const auto height = options.height;
+    const auto first_row = source.levels[0].first_row;
+    const auto rows = static_cast<int>(source.raster.size() / sizeof(std::int16_t) / width);
+    const std::int16_t* heights = reinterpret_cast<const std::int16_t*>(source.raster.data());
+
+    std::atomic<std::uint64_t> meshes{0};
+    std::atomic<std::uint64_t> skipped{0};
+    std::atomic<std::uint64_t> vertex_count{0};
+    std::atomic<std::uint64_t> triangle_count{0};
+    std::mutex lock;
+    const auto subtile_count = static_cast<int>(std::count_if(source.subtiles.begin(), source.subtiles.end(),
+        [](const Subtile& subtile) { return subtile.level == 0; }
+    ));
+    run_bands(run, 0, subtile_count, [&](const int begin, const int end) {
+        std::vector<float> terrain;
+        std::vector<float> errors;
+        std::vector<std::uint8_t> data;
+        for (auto index = begin; index < end; index++)
+        {
+            const Subtile& subtile = source.subtiles[static_cast<std::size_t>(index)];
+            const auto size = subtile.width;
+            if (size != options.schemes[subtile.scheme].subwidth || subtile.height != size)
+            {
+                skipped++;
+                continue;
+            }
+
+            terrain.resize(static_cast<std::size_t>(size) * size);
+            for (auto y = 0; y < size; y++)
+            {
+                const auto row = subtile.row_offset + y;
+                for (auto x = 0; x < size; x++)
+                {
+                    const auto col = subtile.col_offset + x;
+                    terrain[static_cast<std::size_t>(y) * size + x] = row < height && col < width && row - first_row < rows ?
+                        heights[static_cast<std::size_t>(row - first_row) * width + col] : -32768.0f;
+                }
+            }
+            rtin_errors(terrain, size, errors);
+
+            RtinMesh mesh = { size, static_cast<float>(options.mesh_error), &errors, {}, {}, {} };
+            mesh.indices.assign(terrain.size(), 0);
+            mesh.extract(0, 0, size - 1, size - 1, size - 1, 0);
+            mesh.extract(size - 1, size - 1, 0, 0, 0, size - 1);
+
+            int lowest = 32767;
+            int highest = -32768;
+            const auto vertices = mesh.vertices.size() / 2;
+            for (std::size_t v = 0; v < vertices; v++)
+            {
+                const auto z = static_cast<int>(terrain[static_cast<std::size_t>(mesh.vertices[2 * v + 1]) * size + mesh.vertices[2 * v]]);
+                if (z == -32768) continue;
+                lowest = std::min(lowest, z);
+                highest = std::max(highest, z);
+            }
+            const double west = source.longitude + static_cast<double>(subtile.col_offset) / (width - 1);
+            const double north = source.latitude + 1.0 - static_cast<double>(subtile.row_offset) / (height - 1);
+            const double east = west + static_cast<double>(size - 1) / (width - 1);
+            const double south = north - static_cast<double>(size - 1) / (height - 1);
+            const float max_error = static_cast<float>(options.mesh_error);
+            std::uint32_t error_bits;
+            std::memcpy(&error_bits, &max_error, sizeof(error_bits));
+
+            data.clear();
+            data.insert(data.end(), "HGT2PNGM", "HGT2PNGM" + 8);
+            append_le(data, 1, 4);
+            append_le(data, vertices, 4);
+            append_le(data, mesh.triangles.size() / 3, 4);
+            append_le(data, static_cast<std::uint64_t>(size), 4);
+            append_le(data, error_bits, 4);
+            append_le(data, static_cast<std::uint16_t>(lowest), 2);
+            append_le(data, static_cast<std::uint16_t>(highest), 2);
+            for (const double bound : { west, south, east, north })
+            {
+                std::uint64_t bits;
+                std::memcpy(&bits, &bound, sizeof(bits));
+                append_le(data, bits, 8);
+            }
+            for (std::size_t v = 0; v < vertices; v++)
+            {
+                const auto x = mesh.vertices[2 * v];
+                const auto y = mesh.vertices[2 * v + 1];
+                append_le(data, x, 2);
+                append_le(data, y, 2);
+                append_le(data, static_cast<std::uint16_t>(static_cast<std::int16_t>(terrain[static_cast<std::size_t>(y) * size + x])), 2);
+            }
+            for (const auto vertex : mesh.triangles) append_le(data, vertex, 4);
+
+            const std::string mesh_name = source.base_name + "." + subtile_name(subtile, options) + ".mesh";
+            CFile mesh_file = CFile(std::fopen(mesh_name.c_str(), "wb"), [](FILE* f)->void { std::fclose(f); });
+            if (!mesh_file.get() || std::fwrite(data.data(), data.size(), 1, mesh_file.get()) != 1)
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                if (source.error.empty()) appendf(source.error, "Could not write mesh \"%s\"", mesh_name.c_str());
+                continue;
+            }
+            meshes++;
+            vertex_count += vertices;
+            triangle_count += mesh.triangles.size() / 3;
+        }
+    });
+    if (!source.error.empty()) return false;
+    appendf(source.report, "Mesh: %" PRIu64 " subtiles, %" PRIu64 " vertices, %" PRIu64 " triangles at %g meters error",
+        meshes.load(), vertex_count.load(), triangle_count.load(), options.mesh_error);
+    appendf(source.report, skipped ? ", %" PRIu64 " truncated subtiles skipped\n" : "\n", skipped.load());
+    return true;
+}
+
+/*
+ * Derivation
+ *
+ * The signed heights of a loaded source, starting at row 'first_row', shared by the
+ * row bands deriving its products. The last band to finish releases the heights and
+ * converts and schedules every product source with the options of its mode.
+ */
+struct Derivation {
+    std::vector<std::uint8_t> heights;
+    int first_row = 0;
+    int latitude = 0;
+    std::vector<std::shared_ptr<Source>> products;
+    std::vector<Options> options;
+    std::atomic<int> remaining{0};
+};
+
+/*
+ * The arctangent of y / x from -pi to pi, as std::atan2 within a few float ulps
+ *
+ * Reduced to [-tan(pi/8), tan(pi/8)] for the polynomial of Cephes' atanf, and written
+ * with selects in place of its branches so loops calling it vectorize.
+ */
+inline float select_atan2(const float y, const float x) {
+    const float ax = std::fabs(x);
+    const float ay = std::fabs(y);
+    const float a = std::min(ax, ay) / std::max(std::max(ax, ay), std::numeric_limits<float>::min());
+    const bool reduced = a > 0.41421356f;
+    const float t = reduced ? (a - 1.0f) / (a + 1.0f) : a;
+    const float z = t * t;
+    float r = (((8.05374449538e-2f * z - 1.38776856032e-1f) * z + 1.99777106478e-1f) * z - 3.33329491539e-1f) * z * t + t;
+    r = reduced ? r + 0.78539816f : r;
+    r = ay > ax ? 1.57079633f - r : r;
+    r = x < 0.0f ? 3.14159265f - r : r;
+    return y < 0.0f ? -r : r;
+}
+
+/*
+ * Derive the products of rows 'begin' to 'end' of the heights
+ *
+ * When a stencil product is among them, each row is loaded as floats with its neighbours
+ * above and below, the edges replicated, and the Horn 3x3 stencil gives the gradients of
+ * the whole row in meters per meter. The other products read the heights of the row alone.
+ * A void neighbour takes the height of the centre sample, a void centre stays void.
+ * The pixel spacing comes from the bounds of the source, the east-west spacing
+ * shrinking with the cosine of the latitude of each row. The loops select rather than
+ * branch over contiguous rows, the angles through 'select_atan2', so -O3 vectorizes
+ * them with the makefile's -fno-math-errno and -fno-trapping-math. The normal map and
+ * Terrain-RGB compute their channels into planes first and interleave them in a scalar
+ * loop. Terrarium only shifts each height, so it writes its interleaved bytes directly
+ * in one scalar loop, and the relief table lookups stay scalar as well.
+ */
+void derive_rows(Derivation& derivation, const int begin, const int end, const Options& options) {
+    const auto width = options.width;
+    const auto height = options.height;
+    const auto first_row = derivation.first_row;
+    const auto last_row = first_row + static_cast<int>(derivation.heights.size() / sizeof(std::int16_t) / width) - 1;
+    const std::int16_t* heights = reinterpret_cast<const std::int16_t*>(derivation.heights.data());
+    const float none = -32768.0f;
+
+    std::vector<float> above(width + 2);
+    std::vector<float> middle(width + 2);
+    std::vector<float> below(width + 2);
+    std::vector<float> dzdx(width);
+    std::vector<float> dzdy(width);
+    std::vector<float> scale(width);
+    std::vector<std::uint8_t> planes[3];
+    for (auto& plane : planes) plane.resize(width);
+    std::uint8_t* red = planes[0].data();
+    std::uint8_t* green = planes[1].data();
+    std::uint8_t* blue = planes[2].data();
+    const auto interleave = [&](std::uint8_t* out) {
+        for (auto x = 0; x < width; x++)
+        {
+            out[3 * x + 0] = red[x];
+            out[3 * x + 1] = green[x];
+            out[3 * x + 2] = blue[x];
+        }
+    };
+    const auto load = [&](std::vector<float>& row, const int y) {
+        const std::int16_t* in = heights + static_cast<std::size_t>(std::min(std::max(y, first_row), last_row) - first_row) * width;
+        for (auto x = 0; x < width; x++) row[x + 1] = static_cast<float>(in[x]);
+        row[0] = row[1];
+        row[width + 1] = row[width];
+    };
+
+    const double meters_per_degree = deg_to_rad(1.0) * 6371008.8;
+    const float dy = static_cast<float>(meters_per_degree / (height - 1));
+    const float sun_x = static_cast<float>(std::sin(deg_to_rad(options.sun_azimuth)) * std::cos(deg_to_rad(options.sun_altitude)));
+    const float sun_y = static_cast<float>(std::cos(deg_to_rad(options.sun_azimuth)) * std::cos(deg_to_rad(options.sun_altitude)));
+    const float sun_z = static_cast<float>(std::sin(deg_to_rad(options.sun_altitude)));
+    const float degrees_per_radian = static_cast<float>(1.0 / deg_to_rad(1.0));
+    const std::uint8_t* relief = options.relief ? options.relief->data() : nullptr;
+
+    bool stencil = false;
+    for (const auto& product_options : derivation.options) stencil = stencil || find_product(product_options.product)->stencil;
+
+    for (auto y = begin; y < end; y++)
+    {
+        const std::int16_t* row = heights + static_cast<std::size_t>(y - first_row) * width;
+        if (stencil)
+        {
+            load(above, y - 1);
+            load(middle, y);
+            load(below, y + 1);
+        }
+        const double latitude = derivation.latitude + 1.0 - static_cast<double>(y) / (height - 1);
+        const float dx = static_cast<float>(meters_per_degree * std::cos(deg_to_rad(latitude)) / (width - 1));
+        const float scale_x = 1.0f / (8.0f * dx);
+        const float scale_y = 1.0f / (8.0f * dy);
+
+        /*
+         * a b c
+         * d e f
+         * g h i
+         */
+        const float* up = above.data();
+        const float* mid = middle.data();
+        const float* down = below.data();
+        for (auto x = 0; x < width && stencil; x++)
+        {
+            const float e = mid[x + 1];
+            const float a = up[x] == none ? e : up[x];
+            const float b = up[x + 1] == none ? e : up[x + 1];
+            const float c = up[x + 2] == none ? e : up[x + 2];
+            const float d = mid[x] == none ? e : mid[x];
+            const float f = mid[x + 2] == none ? e : mid[x + 2];
+            const float g = down[x] == none ? e : down[x];
+            const float h = down[x + 1] == none ? e : down[x + 1];
+            const float i = down[x + 2] == none ? e : down[x + 2];
+            dzdx[x] = ((c + 2.0f * f + i) - (a + 2.0f * d + g)) * scale_x;
+            dzdy[x] = ((g + 2.0f * h + i) - (a + 2.0f * b + c)) * scale_y;
+        }
+
+        /*
+         * Write the row of every product, 'dzdy' grows to the south
+         */
+        const auto offset = static_cast<std::size_t>(y - first_row) * width;
+        for (std::size_t p = 0; p < derivation.products.size(); p++)
+        {
+            std::uint8_t* out = derivation.products[p]->raster.data() + offset * derivation.products[p]->format.pixel_size();
+            switch (derivation.options[p].product)
+            {
+            case Product::Hillshade:
+                /*
+                 * Lambertian shading by the sun, from 1 in shadow to 255 facing it, voids encode to 0
+                 */
+                for (auto x = 0; x < width; x++)
+                {
+                    const float light = (sun_z - dzdx[x] * sun_x + dzdy[x] * sun_y) / std::sqrt(1.0f + dzdx[x] * dzdx[x] + dzdy[x] * dzdy[x]);
+                    const int shade = static_cast<int>(1.5f + 254.0f * std::max(light, 0.0f));
+                    out[x] = static_cast<std::uint8_t>(mid[x + 1] == none ? 0 : shade);
+                }
+                break;
+            case Product::Slope:
+                /*
+                 * Degrees from the horizontal, voids encode to 0xFFFF
+                 */
+                for (auto x = 0; x < width; x++)
+                {
+                    const float degrees = select_atan2(std::sqrt(dzdx[x] * dzdx[x] + dzdy[x] * dzdy[x]), 1.0f) * degrees_per_radian;
+                    const int value = static_cast<int>(degrees * (65534.0f / 90.0f) + 0.5f);
+                    reinterpret_cast<std::uint16_t*>(out)[x] = static_cast<std::uint16_t>(mid[x + 1] == none ? 0xFFFF : value);
+                }
+                break;
+            case Product::Aspect:
+                /*
+                 * Degrees clockwise from north the ground faces downhill, voids and flat ground encode to 0xFFFF
+                 */
+                for (auto x = 0; x < width; x++)
+                {
+                    float degrees = select_atan2(-dzdx[x], dzdy[x]) * degrees_per_radian;
+                    degrees = degrees < 0.0f ? degrees + 360.0f : degrees;
+                    const int value = static_cast<int>(degrees * (65534.0f / 360.0f) + 0.5f);
+                    const bool skip = (mid[x + 1] == none) | ((dzdx[x] == 0.0f) & (dzdy[x] == 0.0f));
+                    reinterpret_cast<std::uint16_t*>(out)[x] = static_cast<std::uint16_t>(skip ? 0xFFFF : value);
+                }
+                break;
+            case Product::Normal:
+                /*
+                 * The unit surface normal, east, north and up, mapped from [-1, 1] to [0, 255]
+                 * in red, green and blue. No unit normal encodes to black, so voids do.
+                 */
+                for (auto x = 0; x < width; x++) scale[x] = 127.5f / std::sqrt(1.0f + dzdx[x] * dzdx[x] + dzdy[x] * dzdy[x]);
+                for (auto x = 0; x < width; x++)
+                {
+                    const int east = static_cast<int>(127.5f - dzdx[x] * scale[x] + 0.5f);
+                    red[x] = static_cast<std::uint8_t>(mid[x + 1] == none ? 0 : east);
+                }
+                for (auto x = 0; x < width; x++)
+                {
+                    const int north = static_cast<int>(127.5f + dzdy[x] * scale[x] + 0.5f);
+                    green[x] = static_cast<std::uint8_t>(mid[x + 1] == none ? 0 : north);
+                }
+                for (auto x = 0; x < width; x++)
+                {
+                    const int up = static_cast<int>(127.5f + scale[x] + 0.5f);
+                    blue[x] = static_cast<std::uint8_t>(mid[x + 1] == none ? 0 : up);
+                }
+                interleave(out);
+                break;
+            case Product::TerrainRgb:
+                /*
+                 * Tenths of a meter above -10000 meters as a 24 bit red, green, blue integer,
+                 * voids encode to black
+                 */
+                for (auto x = 0; x < width; x++)
+                {
+                    const std::int32_t above = static_cast<std::int32_t>(row[x]) + 10000;
+                    const std::int32_t tenths = above < 0 ? 0 : above * 10;
+                    const std::int32_t value = row[x] == -32768 ? 0 : tenths;
+                    red[x] = static_cast<std::uint8_t>(value >> 16);
+                    green[x] = static_cast<std::uint8_t>(value >> 8);
+                    blue[x] = static_cast<std::uint8_t>(value);
+                }
+                interleave(out);
+                break;
+            case Product::Terrarium:
+                /*
+                 * Meters above -32768 meters in red and green, fractions in blue, which whole
+                 * meters leave 0. Voids encode to black, the void height itself.
+                 */
+                for (auto x = 0; x < width; x++)
+                {
+                    const std::int32_t value = static_cast<std::int32_t>(row[x]) + 32768;
+                    out[3 * x + 0] = static_cast<std::uint8_t>(value >> 8);
+                    out[3 * x + 1] = static_cast<std::uint8_t>(value);
+                    out[3 * x + 2] = 0;
+                }
+                break;
+            case Product::Relief:
+                /*
+                 * The color of each height looked up in the ramp's table, a load per sample
+                 * that the compiler does not vectorize
+                 */
+                if (options.relief_alpha)
+                {
+                    for (auto x = 0; x < width; x++) std::memcpy(out + 4 * x, relief + 4 * static_cast<std::uint16_t>(row[x]), 4);
+                }
+                else
+                {
+                    for (auto x = 0; x < width; x++) std::memcpy(out + 3 * x, relief + 4 * static_cast<std::uint16_t>(row[x]), 3);
+                }
+                break;
+            case Product::Elevation:
+                break;
+            }
+        }
+    }
+}
+
+/*
+ * Load a HGT source into a pooled buffer, convert it and schedule its subtiles
+ *
+ * Every further output mode copies the scanned raster into a pooled buffer of its own,
+ * and is converted and scheduled on the pool while the first mode converts here.
+ * When there are derived products the heights stay in a buffer of their own, shared
+ * by the row bands deriving every product in one pass, and the elevation modes copy them.
+ */
+void convert_source(const std::string& filename, Run& run) {
+    std::shared_ptr<Source> source = std::make_shared<Source>();
+    source->filename = filename;
+    source->raster = run.buffers->acquire();
+    if (!load_source(*source, run))
+    {
+        finish_source(*source, run);
+        return;
+    }
+
+    if (run.options.fill > 0 && source->voids > 0 && !source->cached) fill_voids(*source, run);
+    if (run.options.contours > 0 && !trace_contours(*source, run))
+    {
+        finish_source(*source, run);
+        return;
+    }
+    if (run.options.mesh && !build_meshes(*source, run))
+    {
+        finish_source(*source, run);
+        return;
+    }
+
+    const auto& modes = run.options.modes;
+    std::shared_ptr<Derivation> derivation;
+    if (std::any_of(modes.begin(), modes.end(), [](const OutputMode& mode) { return mode.product != Product::Elevation; }))
+    {
+        derivation = std::make_shared<Derivation>();
+        derivation->heights = std::move(source->raster);
+        derivation->first_row = source->levels[0].first_row;
+        derivation->latitude = source->latitude;
+        source->raster = run.buffers->acquire();
+    }
+    const std::vector<std::uint8_t>& heights = derivation ? derivation->heights : source->raster;
+    const auto pixel_count = heights.size() / sizeof(std::int16_t);
+
+    std::vector<Task> tasks;
+    for (std::size_t m = 1; m < modes.size(); m++)
+    {
+        std::shared_ptr<Source> derived = std::make_shared<Source>();
+        derived->filename = filename;
+        derived->base_name = output_base_name(modes[m].prefix, filename);
+        derived->derived = true;
+        derived->size = source->size;
+        derived->latitude = source->latitude;
+        derived->longitude = source->longitude;
+        derived->levels = source->levels;
+        derived->subtiles = source->subtiles;
+        derived->outputs.resize(source->subtiles.size());
+        derived->overviews.resize(source->overviews.size());
+        derived->manifest.source_hash = source->manifest.source_hash;
+        derived->manifest.minimum = source->manifest.minimum;
+        derived->manifest.maximum = source->manifest.maximum;
+        derived->voids = source->voids;
+        derived->filled = source->filled;
+        derived->raster = run.buffers->acquire();
+        appendf(derived->report, "File: \"%s\"\nMode: %s as \"%s\"\n",
+            filename.c_str(), mode_name(modes[m]), derived->base_name.c_str()
+        );
+
+        Options options = run.options;
+        options.absolute = modes[m].absolute;
+        options.product = modes[m].product;
+        options.prefix = modes[m].prefix;
+        if (modes[m].product != Product::Elevation)
+        {
+            derived->format = product_format(run.options, modes[m].product);
+            derived->raster.resize(pixel_count * derived->format.pixel_size());
+            derivation->products.push_back(derived);
+            derivation->options.push_back(options);
+            continue;
+        }
+        derived->raster.assign(heights.begin(), heights.end());
+        tasks.push_back({ std::numeric_limits<std::uint64_t>::max(), [derived, options, &run]() {
+            convert_raster(*derived, options);
+            schedule_source(derived, run);
+        }});
+    }
+    if (modes.size() > 1)
+    {
+        appendf(source->report, "Mode: %s as \"%s\"\n", mode_name(modes[0]), source->base_name.c_str());
+    }
+
+    /*
+     * Derive the products in bands of rows, one per worker
+     */
+    if (derivation)
+    {
+        if (modes[0].product != Product::Elevation)
+        {
+            source->format = product_format(run.options, modes[0].product);
+            source->raster.resize(pixel_count * source->format.pixel_size());
+            derivation->products.push_back(source);
+            derivation->options.push_back(run.options);
+        }
+        else source->raster.assign(heights.begin(), heights.end());
+
+        const auto first_row = derivation->first_row;
+        const auto row_count = static_cast<int>(pixel_count / run.options.width);
+        const auto band_rows = std::max(16, (row_count + static_cast<int>(run.options.threads) - 1) / static_cast<int>(run.options.threads));
+        derivation->remaining = (row_count + band_rows - 1) / band_rows;
+        for (auto begin = first_row; begin < first_row + row_count; begin += band_rows)
+        {
+            const auto end = std::min(begin + band_rows, first_row + row_count);
+            tasks.push_back({ std::numeric_limits<std::uint64_t>::max(), [derivation, begin, end, &run]() {
+                derive_rows(*derivation, begin, end, run.options);
+                if (--derivation->remaining > 0) return;
+                run.buffers->release(std::move(derivation->heights));
+                for (std::size_t p = 0; p < derivation->products.size(); p++)
+                {
+                    convert_raster(*derivation->products[p], derivation->options[p]);
+                    schedule_source(derivation->products[p], run);
+                }
+            }});
+        }
+    }
+    run.pool->submit(std::move(tasks));
+    if (modes[0].product != Product::Elevation) return;
+
+    convert_raster(*source, run.options);
+    if (!run.options.cache.empty() && !source->cached && !run.options.roi && !write_raster_cache(*source, run.options))
+    {
+        appendf(source->report, "Could not write cache \"%s\"\n", raster_cache_name(run.options, filename).c_str());
+    }
+    if (source->shared.creating())
+    {
+        publish_shared_raster(*source, run.options);
+        std::vector<std::uint8_t>().swap(source->raster);
+    }
+    schedule_source(source, run);
+}
+
+/*
+ * Gather the statistics of every source and their common range
+ *
+ * A source whose sidecar matches its size and modification time is not read again,
+ * the others are read, scanned and get a new sidecar. Sources that cannot be read
+ * are left out of the range, the encode pass reports them. Clipping merges the
+ * histograms of every source and takes the common range from their percentiles.
+ */
+void gather_stats(const std::vector<std::string>& filenames, Run& run) {
+    Options& options = run.options;
+    const auto pixel_count = static_cast<std::size_t>(options.source_width) * options.source_height;
+    std::atomic<int> minimum{32768};
+    std::atomic<int> maximum{-32768};
+    std::atomic<int> cached{0};
+    std::atomic<int> gathered{0};
+    std::vector<std::int64_t> merged(options.clip ? 65536 : 0);
+    std::mutex merge_lock;
+    std::vector<Task> tasks;
+    for (const auto& filename : filenames)
+    {
+        tasks.push_back({ 1, [filename, pixel_count, &run, &minimum, &maximum, &cached, &gathered, &merged, &merge_lock]() {
+            Source source;
+            source.filename = filename;
+            const std::string stats_name = output_base_name(run.options.prefix, filename) + ".stats";
+
+            SourceStats stats;
+            const auto size = file_size(filename.c_str());
+            const auto modified = file_time(filename.c_str());
+            if (read_stats(stats_name, stats) && stats.size == size && stats.modified == modified)
+            {
+                cached++;
+            }
+            else
+            {
+                if (!read_source(source, run.options)) return;
+                stats = SourceStats();
+                stats.size = size;
+                stats.modified = modified;
+                stats.source_hash = hash64(source.raster.data(), source.raster.size());
+                std::vector<std::int64_t> histogram(65536);
+                const std::uint8_t* bytes = source.raster.data();
+                for (std::size_t i = 0; i < pixel_count; i++)
+                {
+                    const auto value = static_cast<std::int16_t>((bytes[2 * i] << 8) | bytes[2 * i + 1]);
+                    histogram[static_cast<std::uint16_t>(value)]++;
+                }
+                for (auto value = -32767; value <= 32767; value++)
+                {
+                    const auto count = histogram[static_cast<std::uint16_t>(value)];
+                    if (count == 0) continue;
+                    stats.histogram[value] = count;
+                    stats.minimum = std::min(stats.minimum, value);
+                    stats.maximum = std::max(stats.maximum, value);
+                }
+                stats.voids = histogram[0x8000];
+                if (!write_stats(stats_name, stats))
+                {
+                    std::lock_guard<std::mutex> guard(run.lock);
+                    std::printf("Could not write statistics \"%s\"\n", stats_name.c_str());
+                }
+                gathered++;
+            }
+            if (run.options.clip)
+            {
+                std::lock_guard<std::mutex> guard(merge_lock);
+                for (const auto& entry : stats.histogram) merged[static_cast<std::uint16_t>(entry.first)] += entry.second;
+            }
+            for (auto current = minimum.load(); stats.minimum < current && !minimum.compare_exchange_weak(current, stats.minimum);) {}
+            for (auto current = maximum.load(); stats.maximum > current && !maximum.compare_exchange_weak(current, stats.maximum);) {}
+        }});
+    }
+    run.pool->submit(std::move(tasks));
+    run.pool->wait();
+
+    options.global_minimum = options.clip ? histogram_percentile(merged, options.clip_low) : minimum.load();
+    options.global_maximum = options.clip ? histogram_percentile(merged, options.clip_high) : maximum.load();
+    std::printf("Statistics: %d gathered, %d cached, Range: [%d, %d] meters\n",
+        gathered.load(), cached.load(), options.global_minimum, options.global_maximum
+    );
+}
+
+/*
+ * Create the directories leading up to a file
+ */
+bool make_directories(const std::string& filename) {
+    for (auto pos = filename.find_first_of("/\\", 1); pos != std::string::npos; pos = filename.find_first_of("/\\", pos + 1))
+    {
+        const std::string directory = filename.substr(0, pos);
+#if defined(_MSC_VER)
+        if (_mkdir(directory.c_str()) != 0 && errno != EEXIST) return false;
+#else
+        if (mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST) return false;
+#endif
+    }
+    return true;
+}
+
+/*
+ * Tar Archive
+ *
+ * Collects the outputs into a single ustar archive, entries are appended as they are written
+ */
+class TarArchive {
+public:
+    bool open(const std::string& filename) {
+        file = CFile(std::fopen(filename.c_str(), "wb"), [](FILE* f)->void { std::fclose(f); });
+        return file.get() != nullptr;
+    }
+
+    bool add(const std::string& name, const std::vector<std::uint8_t>& data) {
+        char header[512] = {};
+        std::snprintf(header, 100, "%s", name.c_str());
+        std::snprintf(header + 100, 8, "%07o", 0644);
+        std::snprintf(header + 108, 8, "%07o", 0);
+        std::snprintf(header + 116, 8, "%07o", 0);
+        std::snprintf(header + 124, 12, "%011llo", static_cast<unsigned long long>(data.size()));
+        std::snprintf(header + 136, 12, "%011llo", static_cast<unsigned long long>(std::time(nullptr)));
+        std::memset(header + 148, ' ', 8);
+        header[156] = '0';
+        std::memcpy(header + 257, "ustar", 6);
+        std::memcpy(header + 263, "00", 2);
+        unsigned checksum = 0;
+        for (const auto c : header) checksum += static_cast<unsigned char>(c);
+        std::snprintf(header + 148, 8, "%06o", checksum);
+        header[155] = ' ';
+
+        const char padding[512] = {};
+        const auto pad = (512 - data.size() % 512) % 512;
+        std::lock_guard<std::mutex> guard(lock);
+        return
+            std::fwrite(header, sizeof(header), 1, file.get()) == 1 &&
+            (data.empty() || std::fwrite(data.data(), data.size(), 1, file.get()) == 1) &&
+            (pad == 0 || std::fwrite(padding, pad, 1, file.get()) == 1);
+    }
+
+    bool close() {
+        const char end[1024] = {};
+        const bool written = std::fwrite(end, sizeof(end), 1, file.get()) == 1;
+        return (std::fclose(file.release()) == 0) && written;
+    }
+
+private:
+    CFile file = CFile(nullptr, [](FILE* f)->void { std::fclose(f); });
+    std::mutex lock;
+};
+
+/*
+ * Mosaic
+ *
+ * A virtual raster over every source, indexed by the 1 degree cell parsed from its name.
+ * Neighbouring cells share their edge rows and columns, so C x R cells span
+ * C * (width - 1) + 1 by R * (height - 1) + 1 samples, row 0 being the north edge.
+ * A source is only mapped once a tile reads from it, and only the rows read are paged in.
+ * XYZ tiles resample from the cells of a mosaic as well.
+ */
+struct MosaicCell {
+    std::string filename;
+    std::once_flag mapped;
+    MappedFile file;
+    bool valid = false;
+};
+
+class Mosaic {
+public:
+    Mosaic(const int width, const int height) : width(width), height(height) {}
+
+    /*
+     * Add a source as the cell parsed from its name.
+     * Returns false with 'error' set when the name holds no location, the cell is
+     * already taken, or the source cannot be opened or is not 'width' x 'height' samples.
+     */
+    bool add(const std::string& filename, std::string& error) {
+        const char* last_slash = std::strrchr(filename.c_str(), DIRECTORY_DELIM);
+        Location location;
+        if (!parse_location(last_slash ? last_slash + 1 : filename.c_str(), location))
+        {
+            error = "Invalid location";
+            return false;
+        }
+        const auto key = std::make_pair(location.latitude, location.longitude);
+        if (cells.count(key))
+        {
+            error = "Duplicate location";
+            return false;
+        }
+        const auto size = file_size(filename.c_str());
+        const auto expected = static_cast<std::int64_t>(width) * height * static_cast<std::int64_t>(sizeof(std::int16_t));
+        if (size < 0)
+        {
+            appendf(error, "Could not open file \"%s\"", filename.c_str());
+            return false;
+        }
+        if (size != expected)
+        {
+            appendf(error, "Actual size %" PRId64 ", Expected %" PRId64, size, expected);
+            return false;
+        }
+        std::unique_ptr<MosaicCell>& cell = cells[key];
+        cell.reset(new MosaicCell());
+        cell->filename = filename;
+        bytes += size;
+        west = std::min(west, location.longitude);
+        east = std::max(east, location.longitude + 1);
+        south = std::min(south, location.latitude);
+        north = std::max(north, location.latitude + 1);
+        return true;
+    }
+
+    int samples_x() const { return (east - west) * (width - 1) + 1; }
+    int samples_y() const { return (north - south) * (height - 1) + 1; }
+
+    /*
+     * The big endian samples of a cell, mapped on first use.
+     * Returns nullptr where no source covers the cell or it cannot be mapped.
+     */
+    const std::int16_t* map(MosaicCell& cell) {
+        std::call_once(cell.mapped, [&cell, this]() {
+            cell.valid =
+                cell.file.open(cell.filename.c_str()) &&
+                cell.file.size() == static_cast<std::size_t>(width) * height * sizeof(std::int16_t);
+        });
+        return cell.valid ? reinterpret_cast<const std::int16_t*>(cell.file.data()) : nullptr;
+    }
+
+    const std::int16_t* map(const int cell_row, const int cell_col) {
+        if (cell_row < 0 || cell_col < 0) return nullptr;
+        const auto found = cells.find(std::make_pair(north - 1 - cell_row, west + cell_col));
+        return found != cells.end() ? map(*found->second) : nullptr;
+    }
+
+    /*
+     * Big endian samples of row 'y' of the cell holding mosaic sample (x, y),
+     * starting at that cell's first column, and the mosaic column of that first column.
+     * A sample on an edge shared with a missing cell is taken from the cell west, north
+     * or north west of it that shares it. Returns nullptr where no source covers the sample.
+     */
+    const std::int16_t* row(const int x, const int y, int& cell_x) {
+        const auto cell_col = std::min(x / (width - 1), east - west - 1);
+        const auto cell_row = std::min(y / (height - 1), north - south - 1);
+        const bool shared_x = x == cell_col * (width - 1);
+        const bool shared_y = y == cell_row * (height - 1);
+        for (auto k = 0; k < 4; k++)
+        {
+            const auto dx = k & 1;
+            const auto dy = k >> 1;
+            if ((dx && !shared_x) || (dy && !shared_y)) continue;
+            const std::int16_t* samples = map(cell_row - dy, cell_col - dx);
+            if (!samples) continue;
+            cell_x = (cell_col - dx) * (width - 1);
+            return samples + static_cast<std::size_t>(y - (cell_row - dy) * (height - 1)) * width;
+        }
+        cell_x = cell_col * (width - 1);
+        return nullptr;
+    }
+
+    /*
+     * Whether any source lies within mosaic samples [x0, x1) by [y0, y1)
+     */
+    bool covers(const int x0, const int y0, const int x1, const int y1) const {
+        for (auto r = y0 / (height - 1); r <= std::min((y1 - 1) / (height - 1), north - south - 1); r++)
+        {
+            for (auto c = x0 / (width - 1); c <= std::min((x1 - 1) / (width - 1), east - west - 1); c++)
+            {
+                if (cells.count(std::make_pair(north - 1 - r, west + c))) return true;
+            }
+        }
+        return false;
+    }
+
+    std::map<std::pair<int, int>, std::unique_ptr<MosaicCell>> cells;
+    std::int64_t bytes = 0;
+    const int width;
+    const int height;
+    int west = 180;
+    int east = -180;
+    int south = 90;
+    int north = -90;
+};
+
+/*
+ * Swap a big endian HGT sample to the platform order
+ */
+std::int16_t from_big_endian(const std::int16_t value) {
+    if (!is_little_endian()) return value;
+    const auto bits = static_cast<std::uint16_t>(value);
+    return static_cast<std::int16_t>(static_cast<std::uint16_t>((bits >> 8) | (bits << 8)));
+}
+
+/*
+ * Scan the common range of the valid heights of every cell of a mosaic on the pool.
+ * A mosaic without a valid height has the empty range [0, 0], as a source does.
+ */
+void scan_mosaic_range(Mosaic& mosaic, Run& run, int& minimum, int& maximum) {
+    std::atomic<int> lowest{32768};
+    std::atomic<int> highest{-32768};
+    std::vector<Task> tasks;
+    for (const auto& cell : mosaic.cells)
+    {
+        MosaicCell* source = cell.second.get();
+        tasks.push_back({ 1, [&mosaic, source, &lowest, &highest]() {
+            const std::int16_t* samples = mosaic.map(*source);
+            if (!samples) return;
+            int lo = 32768;
+            int hi = -32768;
+            const auto pixel_count = static_cast<std::size_t>(mosaic.width) * mosaic.height;
+            for (std::size_t i = 0; i < pixel_count; i++)
+            {
+                const auto value = from_big_endian(samples[i]);
+                if (value == -32768) continue;
+                lo = std::min(lo, static_cast<int>(value));
+                hi = std::max(hi, static_cast<int>(value));
+            }
+            for (auto current = lowest.load(); lo < current && !lowest.compare_exchange_weak(current, lo);) {}
+            for (auto current = highest.load(); hi > current && !highest.compare_exchange_weak(current, hi);) {}
+        }});
+    }
+    run.pool->submit(std::move(tasks));
+    run.pool->wait();
+    minimum = lowest.load();
+    maximum = highest.load();
+    if (minimum > maximum) minimum = maximum = 0;
+}
+
+/*
+ * Web Mercator (EPSG:3857)
+ *
+ * Conversions between degrees and the fractional XYZ tile coordinates of a zoom level
+ */
+double mercator_lon(const double x, const int zoom) {
+    return x / std::ldexp(1.0, zoom) * 360.0 - 180.0;
+}
+
+double mercator_lat(const double y, const int zoom) {
+    const double pi = 3.14159265358979323846;
+    return std::atan(std::sinh(pi * (1.0 - 2.0 * y / std::ldexp(1.0, zoom)))) * 180.0 / pi;
+}
+
+int mercator_x(const double lon, const int zoom) {
+    const int n = 1 << zoom;
+    return std::max(0, std::min(n - 1, static_cast<int>(std::floor((lon + 180.0) / 360.0 * n))));
+}
+
+int mercator_y(const double lat, const int zoom) {
+    const double pi = 3.14159265358979323846;
+    const int n = 1 << zoom;
+    const double phi = deg_to_rad(std::max(-85.0511287798, std::min(85.0511287798, lat)));
+    const double y = (1.0 - std::log(std::tan(phi) + 1.0 / std::cos(phi)) / pi) / 2.0 * n;
+    return std::max(0, std::min(n - 1, static_cast<int>(std::floor(y))));
+}
+
+/*
+ * Resampling table entry of an XYZ tile
+ *
+ * For one output column (row), the 1 degree cell it falls in, the first of the two
+ * source columns (rows) it interpolates between and the weight of the second
+ */
+struct Sampling {
+    int cell;
+    int index;
+    float weight;
+};
+
+/*
+ * Render, encode and write one XYZ tile
+ *
+ * The tile is bilinearly resampled from the mapped sources covering it, each sample converted
+ * as it is read, voids carry no weight.
+ * Trigonometry is only evaluated per output row and column, never per pixel.
+ */
+void encode_xyz_tile(Mosaic& mosaic, const int zoom, const int x, const int y, Run& run, TarArchive* archive)
+{
+    const Options& options = run.options;
+    const int size = options.xyz_size;
+    const int width = options.width;
+    const int height = options.height;
+
+    /*
+     * Precompute the column and row tables
+     */
+    std::vector<Sampling> columns(size);
+    std::vector<Sampling> rows(size);
+    for (auto i = 0; i < size; i++)
+    {
+        const double lon = mercator_lon(x + (i + 0.5) / size, zoom);
+        const double fx = (lon - std::floor(lon)) * (width - 1);
+        columns[i].cell = static_cast<int>(std::floor(lon));
+        columns[i].index = std::min(static_cast<int>(fx), width - 2);
+        columns[i].weight = static_cast<float>(fx - columns[i].index);
+
+        const double lat = mercator_lat(y + (i + 0.5) / size, zoom);
+        const double fy = (std::floor(lat) + 1.0 - lat) * (height - 1);
+        rows[i].cell = static_cast<int>(std::floor(lat));
+        rows[i].index = std::min(static_cast<int>(fy), height - 2);
+        rows[i].weight = static_cast<float>(fy - rows[i].index);
+    }
+
+    /*
+     * Resolve the sources of the few cells the tile spans once
+     */
+    const auto col_cell0 = columns[0].cell;
+    const auto row_cell0 = rows[size - 1].cell;
+    const auto col_cells = columns[size - 1].cell - col_cell0 + 1;
+    const auto row_cells = rows[0].cell - row_cell0 + 1;
+    std::vector<const std::int16_t*> grid(static_cast<std::size_t>(col_cells) * row_cells, nullptr);
+    for (auto r = 0; r < row_cells; r++)
+    {
+        for (auto c = 0; c < col_cells; c++)
+        {
+            const auto found = mosaic.cells.find(std::make_pair(row_cell0 + r, col_cell0 + c));
+            if (found != mosaic.cells.end()) grid[r * col_cells + c] = mosaic.map(*found->second);
+        }
+    }
+    const auto convert = [&options, &run](const std::int16_t sample) {
+        const auto value = from_big_endian(sample);
+        return options.absolute ? to_absolute(value) : to_relative(value, run.xyz_minf, run.xyz_deltaf);
+    };
+
+    /*
+     * Resample
+     */
+    std::vector<std::uint16_t> tile(static_cast<std::size_t>(size) * size);
+    for (auto j = 0; j < size; j++)
+    {
+        const Sampling& row = rows[j];
+        const std::int16_t* const* grid_row = grid.data() + (row.cell - row_cell0) * col_cells;
+        std::uint16_t* out = tile.data() + static_cast<std::size_t>(j) * size;
+        for (auto i = 0; i < size; i++)
+        {
+            const Sampling& column = columns[i];
+            const std::int16_t* data = grid_row[column.cell - col_cell0];
+            if (!data)
+            {
+                out[i] = 0xFFFF;
+                continue;
+            }
+            const std::int16_t* p = data + static_cast<std::size_t>(row.index) * width + column.index;
+            const std::uint16_t v[4] = { convert(p[0]), convert(p[1]), convert(p[width]), convert(p[width + 1]) };
+            const float w[4] = {
+                (1.0f - column.weight) * (1.0f - row.weight), column.weight * (1.0f - row.weight),
+                (1.0f - column.weight) * row.weight, column.weight * row.weight
+            };
+            float sum = 0.0f;
+            float weight = 0.0f;
+            for (auto k = 0; k < 4; k++)
+            {
+                const float wk = v[k] != 0xFFFF ? w[k] : 0.0f;
+                sum += wk * v[k];
+                weight += wk;
+            }
+            out[i] = weight > 0.0f ? static_cast<std::uint16_t>(std::min(65534.0f, sum / weight + 0.5f)) : 0xFFFF;
+        }
+    }
+
+    /*
+     * Encode, constant tiles come from the cache
+     */
+    PngCalibration cal;
+    cal.upx = deg_to_rad(360.0 / std::ldexp(1.0, zoom) / size);
+    cal.upy = cal.upx;
+    cal.minf = run.xyz_minf;
+    cal.deltaf = run.xyz_deltaf;
+
+    std::vector<std::uint8_t> png_data;
+    const std::vector<std::uint8_t>* encoded = &png_data;
+    if (std::all_of(tile.begin(), tile.end(), [&tile](const std::uint16_t v) { return v == tile[0]; }))
+    {
+        encoded = &run.constants.get(size, size, tile[0], cal);
+    }
+    else
+    {
+        std::vector<std::uint8_t*> png_rows(size);
+        for (auto j = 0; j < size; j++) png_rows[j] = reinterpret_cast<std::uint8_t*>(tile.data() + static_cast<std::size_t>(j) * size);
+        encode_png(png_data, size, size, cal, png_rows.data());
+    }
+
+    /*
+     * Write the tile to <Output Prefix><Z>/<X>/<Y>.png or into the archive
+     */
+    const std::string name = std::to_string(zoom) + "/" + std::to_string(x) + "/" + std::to_string(y) + ".png";
+    bool written = false;
+    if (archive) written = archive->add(name, *encoded);
+    else
+    {
+        const std::string filename = options.prefix + name;
+        make_directories(filename);
+        CFile png_file = CFile(std::fopen(filename.c_str(), "wb"), [](FILE* f)->void { std::fclose(f); });
+        written = png_file.get() && std::fwrite(encoded->data(), encoded->size(), 1, png_file.get()) == 1;
+    }
+    if (!written)
+    {
+        std::lock_guard<std::mutex> guard(run.lock);
+        run.failures.push_back("Could not write tile \"" + name + "\"");
+        return;
+    }
+    run.subtiles++;
+    run.png_bytes += static_cast<std::int64_t>(encoded->size());
+}
+
+/*
+ * Convert a set of HGT sources into Web Mercator XYZ tiles
+ *
+ * Every source is verified and mapped as a cell of a mosaic and scanned for the common
+ * range, then each tile touching a source at every zoom in the range is rendered as a task.
+ * Relative mode scales all sources to their common range so that tiles match across cell
+ * boundaries. No source is held in memory, a tile only pages in the rows it samples.
+ */
+void run_xyz(const std::vector<std::string>& filenames, Run& run) {
+    const Options& options = run.options;
+
+    /*
+     * Verify every source and add it to the mosaic
+     */
+    std::vector<std::shared_ptr<Source>> sources;
+    std::vector<Task> tasks;
+    for (const auto& filename : filenames)
+    {
+        std::shared_ptr<Source> source = std::make_shared<Source>();
+        source->filename = filename;
+        sources.push_back(source);
+        tasks.push_back({ 1, [source, &run]() { read_source(*source, run.options, 0, 0); }});
+    }
+    run.pool->submit(std::move(tasks));
+    run.pool->wait();
+
+    Mosaic mosaic(options.width, options.height);
+    for (auto& source : sources)
+    {
+        run.source_bytes += source->size;
+        if (source->error.empty()) mosaic.add(source->filename, source->error);
+        if (!source->error.empty())
+        {
+            std::lock_guard<std::mutex> guard(run.lock);
+            std::printf("%s%s, Skipping...\n", source->report.c_str(), source->error.c_str());
+            run.failures.push_back(source->filename + ": " + source->error);
+            continue;
+        }
+        std::fputs(source->report.c_str(), stdout);
+        run.converted++;
+    }
+
+    /*
+     * Scan the common range of every source
+     */
+    int minimum = 0;
+    int maximum = 0;
+    scan_mosaic_range(mosaic, run, minimum, maximum);
+    run.xyz_minf = static_cast<double>(minimum);
+    run.xyz_deltaf = static_cast<double>(maximum) - run.xyz_minf;
+    std::printf("Range: [%d, %d] meters\n", minimum, maximum);
+
+    /*
+     * Render every tile touching a source
+     */
+    TarArchive archive;
+    const bool archived = options.prefix.size() > 4 && options.prefix.compare(options.prefix.size() - 4, 4, ".tar") == 0;
+    if (archived && !archive.open(options.prefix))
+    {
+        std::lock_guard<std::mutex> guard(run.lock);
+        run.failures.push_back("Could not open archive \"" + options.prefix + "\"");
+        return;
+    }
+    tasks.clear();
+    const auto cost = static_cast<std::uint64_t>(options.xyz_size) * options.xyz_size;
+    for (auto zoom = options.zoom_min; zoom <= options.zoom_max; zoom++)
+    {
+        std::set<std::pair<int, int>> tiles;
+        for (const auto& cell : mosaic.cells)
+        {
+            const auto lat = cell.first.first;
+            const auto lon = cell.first.second;
+            for (auto x = mercator_x(lon, zoom); x <= mercator_x(std::nextafter(lon + 1.0, -180.0), zoom); x++)
+            {
+                for (auto y = mercator_y(std::nextafter(lat + 1.0, -90.0), zoom); y <= mercator_y(lat, zoom); y++)
+                {
+                    tiles.insert(std::make_pair(x, y));
+                }
+            }
+        }
+        for (const auto& tile : tiles)
+        {
+            tasks.push_back({ cost, [&mosaic, zoom, tile, &run, &archive, archived]() {
+                encode_xyz_tile(mosaic, zoom, tile.first, tile.second, run, archived ? &archive : nullptr);
+            }});
+        }
+    }
+    std::printf("XYZ: %zu tiles of %d px, zoom %d to %d\n", tasks.size(), options.xyz_size, options.zoom_min, options.zoom_max);
+    run.pool->submit(std::move(tasks));
+    run.pool->wait();
+    if (archived && !archive.close())
+    {
+        std::lock_guard<std::mutex> guard(run.lock);
+        run.failures.push_back("Could not write archive \"" + options.prefix + "\"");
+    }
+}
+
+/*
+ * Assemble, encode and write one mosaic tile
+ *
+ * Each tile row is gathered from the mapped rows of the one or more sources it crosses
  */
-double deg_to_rad(const double deg) {
-    return deg * 3.14159265358979323846 / 180;
+void encode_mosaic_tile(Mosaic& mosaic, const int row_offset, const int col_offset, const PngCalibration& cal, Run& run) {
+    const Options& options = run.options;
+    const auto tile_width = std::min(options.mosaic_width, mosaic.samples_x() - col_offset);
+    const auto tile_height = std::min(options.mosaic_height, mosaic.samples_y() - row_offset);
+    std::vector<std::uint16_t> tile(static_cast<std::size_t>(tile_width) * tile_height);
+    for (auto j = 0; j < tile_height; j++)
+    {
+        std::uint16_t* out = tile.data() + static_cast<std::size_t>(j) * tile_width;
+        for (auto i = 0; i < tile_width;)
+        {
+            int cell_x = 0;
+            const std::int16_t* row = mosaic.row(col_offset + i, row_offset + j, cell_x);
+            const auto begin = col_offset + i - cell_x;
+
+            /*
+             * A missing cell stops short of its east column, which the next cell may share
+             */
+            const auto span = std::min(tile_width - i, row ? options.width - begin : std::max(1, options.width - 1 - begin));
+            for (auto k = 0; k < span; k++)
+            {
+                if (!row) out[i + k] = 0xFFFF;
+                else
+                {
+                    const auto value = from_big_endian(row[begin + k]);
+                    out[i + k] = options.absolute ? to_absolute(value) : to_relative(value, cal.minf, cal.deltaf);
+                }
+            }
+            i += span;
+        }
+    }
+
+    std::vector<std::uint8_t> png_data;
+    const std::vector<std::uint8_t>* encoded = &png_data;
+    if (std::all_of(tile.begin(), tile.end(), [&tile](const std::uint16_t v) { return v == tile[0]; }))
+    {
+        encoded = &run.constants.get(tile_width, tile_height, tile[0], cal);
+    }
+    else
+    {
+        std::vector<std::uint8_t*> png_rows(tile_height);
+        for (auto j = 0; j < tile_height; j++)
+        {
+            png_rows[j] = reinterpret_cast<std::uint8_t*>(tile.data() + static_cast<std::size_t>(j) * tile_width);
+        }
+        encode_png(png_data, tile_width, tile_height, cal, png_rows.data());
+    }
+
+    const std::string filename =
+        options.prefix + "mosaic." + std::to_string(row_offset) + "." + std::to_string(col_offset) + ".png";
+    CFile png_file = CFile(std::fopen(filename.c_str(), "wb"), [](FILE* f)->void { std::fclose(f); });
+    if (!png_file.get() || std::fwrite(encoded->data(), encoded->size(), 1, png_file.get()) != 1)
+    {
+        std::lock_guard<std::mutex> guard(run.lock);
+        run.failures.push_back("Could not write tile \"" + filename + "\"");
+        return;
+    }
+    run.subtiles++;
+    run.png_bytes += static_cast<std::int64_t>(encoded->size());
 }
 
 /*
- * libpng 'write' function
- * 
- * Write a png to a std::vector of bytes
+ * Convert a set of HGT sources into seamless tiles of a fixed size
+ *
+ * Tiles are laid out from the north west corner of the mosaic and share their edges,
+ * those at the east and south edges are truncated. Relative mode scans every source
+ * for the common range first, absolute mode only reads the rows of the tiles written.
  */
-void libpng_write_stdvector(png_structp png_ptr, png_bytep data, png_size_t length) {
-    std::vector<std::uint8_t>* png = reinterpret_cast<std::vector<std::uint8_t>*>(png_get_io_ptr(png_ptr));
-    png->insert(png->end(), data, data + length);
+void run_mosaic(const std::vector<std::string>& filenames, Run& run) {
+    const Options& options = run.options;
+    Mosaic mosaic(options.width, options.height);
+    for (const auto& filename : filenames)
+    {
+        std::string error;
+        if (!mosaic.add(filename, error))
+        {
+            std::lock_guard<std::mutex> guard(run.lock);
+            std::printf("File: \"%s\"\n%s, Skipping...\n", filename.c_str(), error.c_str());
+            run.failures.push_back(filename + ": " + error);
+        }
+    }
+    run.source_bytes += mosaic.bytes;
+    if (mosaic.cells.empty()) return;
+
+    /*
+     * Scan the common range of every source for relative mode
+     */
+    int minimum = 0;
+    int maximum = 0;
+    if (!options.absolute)
+    {
+        scan_mosaic_range(mosaic, run, minimum, maximum);
+        std::printf("Range: [%d, %d] meters\n", minimum, maximum);
+    }
+
+    PngCalibration cal;
+    cal.upx = deg_to_rad(1.0 / static_cast<double>(options.width - 1));
+    cal.upy = deg_to_rad(1.0 / static_cast<double>(options.height - 1));
+    cal.minf = options.absolute ? 0.0 : static_cast<double>(minimum);
+    cal.deltaf = options.absolute ? 0.0 : static_cast<double>(maximum) - cal.minf;
+
+    /*
+     * Write every tile covering a source
+     */
+    std::vector<Task> tasks;
+    const auto cost = static_cast<std::uint64_t>(options.mosaic_width) * options.mosaic_height;
+    const auto step_x = std::max(1, options.mosaic_width - 1);
+    const auto step_y = std::max(1, options.mosaic_height - 1);
+    for (auto row_offset = 0; row_offset + 1 < mosaic.samples_y(); row_offset += step_y)
+    {
+        for (auto col_offset = 0; col_offset + 1 < mosaic.samples_x(); col_offset += step_x)
+        {
+            const auto x1 = std::min(col_offset + options.mosaic_width, mosaic.samples_x());
+            const auto y1 = std::min(row_offset + options.mosaic_height, mosaic.samples_y());
+            if (!mosaic.covers(col_offset, row_offset, x1, y1)) continue;
+            tasks.push_back({ cost, [&mosaic, row_offset, col_offset, cal, &run]() {
+                encode_mosaic_tile(mosaic, row_offset, col_offset, cal, run);
+            }});
+        }
+    }
+    std::printf("Mosaic: %zu cells, (%d, %d) to (%d, %d), %d x %d samples, %zu tiles of %d x %d\n",
+        mosaic.cells.size(), mosaic.south, mosaic.west, mosaic.north, mosaic.east,
+        mosaic.samples_x(), mosaic.samples_y(), tasks.size(), options.mosaic_width, options.mosaic_height
+    );
+    run.converted += static_cast<int>(mosaic.cells.size());
+    run.pool->submit(std::move(tasks));
+    run.pool->wait();
 }
 
 #define HGT2PNG_USAGE_TEXT\
     "Usage: \n"\
-    "        hgt2png <Mode> <HGT Source> <Output Prefix> <HGT Width> <HGT Height> [<Subwidth> <Subheight>]\n"\
+    "        hgt2png [Options] <Mode> <HGT Source> <Output Prefix> <HGT Width> <HGT Height> [<Subwidth> <Subheight>]\n"\
+    "Options:\n"\
+    "        --manifest    Record hashes in <Output Prefix><SOURCE>.manifest and skip unchanged\n"\
+    "                      sources and subtiles when rerun with the same settings.\n"\
+    "        --global-range\n"\
+    "                      Calibrate every subtile with the range common to all sources, kept\n"\
+    "                      with the histogram of each source in <Output Prefix><SOURCE>.stats\n"\
+    "                      so that sources unchanged since are not read twice.\n"\
+    "        --clip pLOW,pHIGH\n"\
+    "                      Calibrate the relative mode between the LOW and HIGH percentiles of\n"\
+    "                      the heights rather than their range, heights outside saturate. The\n"\
+    "                      histogram is kept in <Output Prefix><SOURCE>.stats, e.g. p1,p99.\n"\
+    "        --modes M[=PREFIX],...\n"\
+    "                      Write every listed mode, 'a', 'r' or a product, from a single read\n"\
+    "                      of each source, in place of <Mode>. Each mode is written behind its\n"\
+    "                      own PREFIX, defaulting to <Output Prefix><M>-.\n"\
+    "        --fill N      Fill voids from the valid samples up to N pixels away, weighted by the\n"\
+    "                      inverse of their squared distance. Voids with none in reach stay void.\n"\
+    "        --contours N  Also trace contour lines every N meters into\n"\
+    "                      <Output Prefix><SOURCE>.contours.geojson.\n"\
+    "        --mesh E      Also write a right-triangulated irregular network of every subtile,\n"\
+    "                      splitting triangles whose midpoint errs by more than E meters, into\n"\
+    "                      <Output Prefix><SOURCE>.<Row>.<Col>.mesh. Subtiles must be squares of\n"\
+    "                      2^k + 1 samples, e.g. --tile-size 257x257 --overlap 1.\n"\
+    "        --ramp FILE   Color ramp of relief, one 'HEIGHT R G B [A]' per line, 'nv' in place of\n"\
+    "                      HEIGHT colors voids. Heights between entries blend their colors.\n"\
+    "        --sun AZ,ALT  Azimuth clockwise from north and altitude of the sun in degrees for\n"\
+    "                      hillshade, defaults to 315,45.\n"\
+    "        --cache DIR   Keep the converted raster of every source in DIR, so later runs in the\n"\
+    "                      same mode map it and go straight to encoding.\n"\
+    "        --cache-limit MB\n"\
+    "                      Remove the least recently used rasters beyond MB, defaults to 1024.\n"\
+    "        --shm         Share the converted raster of every source through POSIX shared memory\n"\
+    "                      with other processes converting the same source in the same mode.\n"\
+    "        --threads N   Number of worker threads, defaults to the number of cores.\n"\
+    "        --prefetch N  Number of sources read ahead while others encode, defaults to 2.\n"\
+    "        --levels N    Also write N overview levels, each at half the resolution of the one\n"\
+    "                      above, as <Output Prefix><SOURCE>.L<Level>.<Row>.<Col>.png.\n"\
+    "        --xyz Z0[-Z1] Instead of subtiles, resample every source onto the Web Mercator\n"\
+    "                      tiles of zooms Z0 to Z1 as <Output Prefix><Z>/<X>/<Y>.png, or into\n"\
+    "                      a tar archive when <Output Prefix> ends in '.tar'.\n"\
+    "        --xyz-size N  Width and height of the XYZ tiles in pixels, defaults to 256.\n"\
+    "        --bbox LAT0,LON0,LAT1,LON1\n"\
+    "                      Only convert the subtiles intersecting the box, reading only their rows.\n"\
+    "        --tiles R.C,...\n"\
+    "                      Only convert the listed subtiles, by row and column index from 0.\n"\
+    "                      A region is calibrated with the range recorded by a previous\n"\
+    "                      --manifest run if there is one, otherwise the range of its rows.\n"\
+    "        --subdivisions RxC,...\n"\
+    "                      Instead of [<Subwidth> <Subheight>], tile every source by each of the\n"\
+    "                      listed rows x columns from one converted raster, as\n"\
+    "                      <Output Prefix><SOURCE>.<R>x<C>.<Row>.<Col>.png when there are several.\n"\
+    "        --resize WxH  Resample every source to W x H samples before tiling, subdivisions and\n"\
+    "                      tile sizes then apply to the resampled raster.\n"\
+    "        --filter bilinear|bicubic|lanczos\n"\
+    "                      Kernel of --resize, defaults to bicubic. Voids carry no weight.\n"\
+    "        --tile-size WxH\n"\
+    "                      Instead of the subdivisions, write W x H subtiles starting every\n"\
+    "                      W - overlap columns and H - overlap rows.\n"\
+    "        --overlap N   Number of rows and columns --tile-size subtiles share, defaults to 0.\n"\
+    "        --edge pad|truncate\n"\
+    "                      Pad the subtiles reaching past the raster with voids or truncate\n"\
+    "                      them to it, defaults to truncate.\n"\
+    "        --mosaic WxH  Instead of subtiles, join every source into one seamless raster and\n"\
+    "                      write W x H tiles sharing their edges, across source boundaries, as\n"\
+    "                      <Output Prefix>mosaic.<Row>.<Col>.png counted from its north west corner.\n"\
     "Note:\n"\
     "        The last two parameters, [<Subwidth> <Subheight>], are optional.\n"\
     "            - If excluded, both default to 1.\n"\
     "            - If included, both must be counting number which evenly subdivide\n"\
     "                  <HGT Width> and <HGT Height>, respectively.\n"\
+    "        <Mode> is 'a' for absolute or 'r' for relative heights, or a product derived from them.\n"\
+    "            - 'hillshade', 8 bit relief shaded by the --sun, voids encode to 0.\n"\
+    "            - 'slope', 16 bit degrees from the horizontal calibrated from 0 to 90.\n"\
+    "            - 'aspect', 16 bit degrees clockwise from north the ground faces, calibrated\n"\
+    "              from 0 to 360, flat ground encodes to 0xFFFF as voids do.\n"\
+    "            - 'normal', 8 bit RGB unit surface normals, east, north and up mapped from\n"\
+    "              -1 to 1 onto 0 to 255, voids encode to black.\n"\
+    "            - 'terrain-rgb', 8 bit RGB heights of -10000 + (R * 65536 + G * 256 + B) * 0.1\n"\
+    "              meters, voids encode to black.\n"\
+    "            - 'terrarium', 8 bit RGB heights of R * 256 + G + B / 256 - 32768 meters,\n"\
+    "              voids encode to black.\n"\
+    "            - 'relief', 8 bit RGB colors of the heights from the --ramp, RGBA when the\n"\
+    "              ramp gives an alpha or a void color.\n"\
+    "            Products listed together in --modes are derived in a single pass.\n"\
+    "        <HGT Source> may also name several sources, converted in one process.\n"\
+    "            - A directory, every '.hgt' file within it.\n"\
+    "            - A pattern containing '*', '?' or '[', e.g. \"srtm/N3*.hgt\".\n"\
+    "            - '@LIST', a file listing one source per line.\n"\
     "\n"\
     "E.G.\n"\
     "        hgt2png a SOURCE.hgt temp/ 3601 3601 2 2\n"\
@@ -91,319 +4223,513 @@ int main(int argc, char** argv)
 {
     /*
      * Arguement Parsing
+     *
+     * Separate the '--' options from the positional arguments
      */
-    if (argc < 6 || argc > 8 || argc == 7)
+    Run run;
+    Options& options = run.options;
+    std::vector<char*> args;
+    const char* modes = nullptr;
+    const char* subdivisions = nullptr;
+    int resize_width = 0;
+    int resize_height = 0;
+    for (auto i = 0; i < argc; i++)
+    {
+        if (i > 0 && std::strncmp(argv[i], "--", 2) == 0)
+        {
+            if (std::strcmp(argv[i], "--manifest") == 0) options.manifest = true;
+            else if (std::strcmp(argv[i], "--global-range") == 0) options.global_range = true;
+            else if (std::strcmp(argv[i], "--shm") == 0) options.shm = true;
+            else if (std::strcmp(argv[i], "--modes") == 0 && i + 1 < argc) modes = argv[++i];
+            else if (std::strcmp(argv[i], "--fill") == 0 && i + 1 < argc)
+            {
+                options.fill = std::max(0, std::atoi(argv[++i]));
+            }
+            else if (std::strcmp(argv[i], "--contours") == 0 && i + 1 < argc)
+            {
+                options.contours = std::max(0, std::atoi(argv[++i]));
+            }
+            else if (std::strcmp(argv[i], "--mesh") == 0 && i + 1 < argc)
+            {
+                char* end = nullptr;
+                options.mesh_error = std::strtod(argv[++i], &end);
+                if (*end != '\0' || !(options.mesh_error >= 0.0))
+                {
+                    std::printf("Invalid mesh error \"%s\", Exiting...\n", argv[i]);
+                    return 1;
+                }
+                options.mesh = true;
+            }
+            else if (std::strcmp(argv[i], "--clip") == 0 && i + 1 < argc)
+            {
+                const char* percents = argv[++i];
+                if ((std::sscanf(percents, "p%lf,p%lf", &options.clip_low, &options.clip_high) != 2 &&
+                     std::sscanf(percents, "%lf,%lf", &options.clip_low, &options.clip_high) != 2) ||
+                    options.clip_low < 0.0 || options.clip_low >= options.clip_high || options.clip_high > 100.0)
+                {
+                    std::printf("Invalid percentiles \"%s\", Exiting...\n", percents);
+                    return 1;
+                }
+                options.clip = true;
+            }
+            else if (std::strcmp(argv[i], "--ramp") == 0 && i + 1 < argc)
+            {
+                if (!read_ramp(argv[++i], options))
+                {
+                    std::printf("Could not read ramp \"%s\", Exiting...\n", argv[i]);
+                    return 1;
+                }
+            }
+            else if (std::strcmp(argv[i], "--sun") == 0 && i + 1 < argc)
+            {
+                if (std::sscanf(argv[++i], "%lf,%lf", &options.sun_azimuth, &options.sun_altitude) != 2 ||
+                    options.sun_altitude < 0.0 || options.sun_altitude > 90.0)
+                {
+                    std::printf("Invalid sun \"%s\", Exiting...\n", argv[i]);
+                    return 1;
+                }
+            }
+            else if (std::strcmp(argv[i], "--cache") == 0 && i + 1 < argc)
+            {
+                options.cache = argv[++i];
+                if (options.cache[options.cache.size() - 1] != DIRECTORY_DELIM) options.cache += DIRECTORY_DELIM;
+            }
+            else if (std::strcmp(argv[i], "--cache-limit") == 0 && i + 1 < argc)
+            {
+                options.cache_limit = std::max(0, std::atoi(argv[++i]));
+            }
+            else if (std::strcmp(argv[i], "--subdivisions") == 0 && i + 1 < argc) subdivisions = argv[++i];
+            else if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            {
+                options.threads = static_cast<unsigned>(std::max(1, std::atoi(argv[++i])));
+            }
+            else if (std::strcmp(argv[i], "--prefetch") == 0 && i + 1 < argc)
+            {
+                options.prefetch = static_cast<unsigned>(std::max(0, std::atoi(argv[++i])));
+            }
+            else if (std::strcmp(argv[i], "--levels") == 0 && i + 1 < argc)
+            {
+                options.levels = std::max(0, std::atoi(argv[++i]));
+            }
+            else if (std::strcmp(argv[i], "--xyz") == 0 && i + 1 < argc)
+            {
+                const auto zooms = std::sscanf(argv[++i], "%d-%d", &options.zoom_min, &options.zoom_max);
+                if (zooms == 1) options.zoom_max = options.zoom_min;
+            }
+            else if (std::strcmp(argv[i], "--xyz-size") == 0 && i + 1 < argc)
+            {
+                options.xyz_size = std::atoi(argv[++i]);
+            }
+            else if (std::strcmp(argv[i], "--bbox") == 0 && i + 1 < argc)
+            {
+                double lat[2] = { 0.0, 0.0 };
+                double lon[2] = { 0.0, 0.0 };
+                if (std::sscanf(argv[++i], "%lf,%lf,%lf,%lf", &lat[0], &lon[0], &lat[1], &lon[1]) != 4)
+                {
+                    std::printf("Invalid bounding box \"%s\", Exiting...\n", argv[i]);
+                    return 1;
+                }
+                options.roi = options.bbox = true;
+                options.bbox_south = std::min(lat[0], lat[1]);
+                options.bbox_north = std::max(lat[0], lat[1]);
+                options.bbox_west = std::min(lon[0], lon[1]);
+                options.bbox_east = std::max(lon[0], lon[1]);
+            }
+            else if (std::strcmp(argv[i], "--tiles") == 0 && i + 1 < argc)
+            {
+                for (const char* tile = argv[++i]; tile && *tile; tile = std::strchr(tile, ','), tile = tile ? tile + 1 : tile)
+                {
+                    std::pair<int, int> index;
+                    if (std::sscanf(tile, "%d.%d", &index.first, &index.second) != 2)
+                    {
+                        std::printf("Invalid subtile \"%s\", Exiting...\n", tile);
+                        return 1;
+                    }
+                    options.tiles.push_back(index);
+                }
+                options.roi = true;
+            }
+            else if (std::strcmp(argv[i], "--resize") == 0 && i + 1 < argc)
+            {
+                if (std::sscanf(argv[++i], "%dx%d", &resize_width, &resize_height) != 2 || resize_width < 2 || resize_height < 2)
+                {
+                    std::printf("Invalid size \"%s\", Exiting...\n", argv[i]);
+                    return 1;
+                }
+                options.resize = true;
+            }
+            else if (std::strcmp(argv[i], "--filter") == 0 && i + 1 < argc)
+            {
+                const char* name = argv[++i];
+                const auto found = std::find_if(std::begin(filter_names), std::end(filter_names),
+                    [name](const decltype(filter_names[0])& entry) { return std::strcmp(entry.name, name) == 0; }
+                );
+                if (found == std::end(filter_names))
+                {
+                    std::printf("Invalid filter \"%s\", Exiting...\n", name);
+                    return 1;
+                }
+                options.filter = found->filter;
+            }
+            else if (std::strcmp(argv[i], "--tile-size") == 0 && i + 1 < argc)
+            {
+                std::sscanf(argv[++i], "%dx%d", &options.subwidth, &options.subheight);
+                if (options.subwidth < 2 || options.subheight < 2)
+                {
+                    std::printf("Invalid tile size \"%s\", Exiting...\n", argv[i]);
+                    return 1;
+                }
+                options.tile_size = true;
+            }
+            else if (std::strcmp(argv[i], "--overlap") == 0 && i + 1 < argc)
+            {
+                options.overlap = std::atoi(argv[++i]);
+            }
+            else if (std::strcmp(argv[i], "--edge") == 0 && i + 1 < argc)
+            {
+                options.pad = std::strcmp(argv[++i], "pad") == 0;
+                if (!options.pad && std::strcmp(argv[i], "truncate") != 0)
+                {
+                    std::printf("Invalid edge \"%s\", Exiting...\n", argv[i]);
+                    return 1;
+                }
+            }
+            else if (std::strcmp(argv[i], "--mosaic") == 0 && i + 1 < argc)
+            {
+                std::sscanf(argv[++i], "%dx%d", &options.mosaic_width, &options.mosaic_height);
+                if (options.mosaic_width < 2 || options.mosaic_height < 2)
+                {
+                    std::printf("Invalid mosaic tile size \"%s\", Exiting...\n", argv[i]);
+                    return 1;
+                }
+            }
+            else
+            {
+                std::printf("Unknown option \"%s\", Exiting...\n", argv[i]);
+                return 1;
+            }
+        }
+        else args.push_back(argv[i]);
+    }
+    const auto argn = static_cast<int>(args.size());
+    if (argn < 6 || argn > 8 || argn == 7)
     {
         std::printf(HGT2PNG_USAGE_TEXT);
-        std::printf("%d\n", argc);
+        std::printf("%d\n", argn);
         return 0;
     }
 
-    const auto width = std::atoi(argv[4]);
-    const auto height = std::atoi(argv[5]);
-    const auto rows = argc == 8 ? std::atoi(argv[6]) : 1;
-    const auto cols = argc == 8 ? std::atoi(argv[7]) : 1;
-    const auto pixel_count = static_cast<std::size_t>(width * height);
-
     /*
-     * Read in the HGT (.hgt) file
-     * 
-     * Check that the file opened properly
+     * Any <Mode> other than 'a' or a product is relative
      */
-    char* hgt_filename = argv[2];
-    CFile hgt_file = CFile(std::fopen(hgt_filename, "rb"), [](FILE* f)->void { std::fclose(f); });
-    if (!hgt_file.get())
+    OutputMode first_mode;
+    if (!parse_mode(args[1], first_mode))
     {
-        std::printf("Could not open file \"%s\", Exiting...\n", hgt_filename);
-        return 1;
+        first_mode.absolute = args[1][0] == 'a';
+        first_mode.product = Product::Elevation;
     }
+    options.absolute = first_mode.absolute;
+    options.product = first_mode.product;
+    options.prefix = args[3];
 
     /*
-     * Extract the number of samples in the HGT raster
+     * Each of the --modes is written behind its own prefix, <Output Prefix><Mode>- by default
      */
-    FSEEK64(hgt_file.get(), 0, SEEK_END);
-    const auto hgt_size = FTELL64(hgt_file.get());
-    FSEEK64(hgt_file.get(), 0, SEEK_SET);
-    std::printf
-    (
-        "File: \"%s\" (%" PRId64 " bytes)\nSize: %d(w) x %d(h) pixels (%lu samples)\n",
-        hgt_filename, hgt_size, width, height, pixel_count
-    );
+    if (modes)
+    {
+        for (const char* mode = modes; mode && *mode; mode = std::strchr(mode, ','), mode = mode ? mode + 1 : mode)
+        {
+            const char* end = std::strchr(mode, ',');
+            const std::string token = end ? std::string(mode, end) : std::string(mode);
+            const auto equals = token.find('=');
+            const std::string name = token.substr(0, equals);
+            OutputMode output;
+            if (!parse_mode(name, output) || (equals != std::string::npos && equals + 1 == token.size()))
+            {
+                std::printf("Invalid mode \"%s\", Exiting...\n", token.c_str());
+                return 1;
+            }
+            output.prefix = equals != std::string::npos ? token.substr(equals + 1) : options.prefix + name + "-";
+            options.modes.push_back(output);
+        }
+        options.absolute = options.modes[0].absolute;
+        options.product = options.modes[0].product;
+        options.prefix = options.modes[0].prefix;
+    }
+    else options.modes.push_back({ options.absolute, options.product, options.prefix });
+    options.width = std::atoi(args[4]);
+    options.height = std::atoi(args[5]);
+    options.source_width = options.width;
+    options.source_height = options.height;
+    if (options.resize)
+    {
+        options.width = resize_width;
+        options.height = resize_height;
+    }
+    options.rows = argn == 8 ? std::atoi(args[6]) : 1;
+    options.cols = argn == 8 ? std::atoi(args[7]) : 1;
+    if (options.threads == 0) options.threads = std::max(1u, std::thread::hardware_concurrency());
+    const auto width = options.width;
+    const auto height = options.height;
 
     /*
-     * Verify the subdivisions
+     * Verify the XYZ zoom range
      */
-    if (cols < 1 || rows < 1)
+    if (options.zoom_min >= 0 &&
+        (options.zoom_max < options.zoom_min || options.zoom_max > 24 || options.xyz_size < 1))
     {
-        std::printf("Both row and column must be greater than or equal to 1, Exiting...\n");
+        std::printf("Invalid XYZ zoom range %d-%d or tile size %d, Exiting...\n",
+            options.zoom_min, options.zoom_max, options.xyz_size
+        );
         return 1;
     }
-    if (cols > 1 && (width - 1) % cols)
+
+    /*
+     * Fixed size tiles are counted to cover the raster, the last row and column may reach past it
+     */
+    if (options.tile_size)
     {
-        std::printf("One less than the width of %d is not evenly divisible by %d, Exiting...\n", width, cols);
-        return 1;
+        if (options.overlap < 0) options.overlap = 0;
+        if (argn == 8 || subdivisions || options.overlap >= std::min(options.subwidth, options.subheight))
+        {
+            std::printf("--tile-size needs no subdivisions and an overlap less than the tile size, Exiting...\n");
+            return 1;
+        }
+        if (options.levels > 0)
+        {
+            std::printf("--levels cannot be combined with --tile-size, Exiting...\n");
+            return 1;
+        }
+        const auto step_x = options.subwidth - options.overlap;
+        const auto step_y = options.subheight - options.overlap;
+        options.cols = width > options.subwidth ? (width - options.subwidth + step_x - 1) / step_x + 1 : 1;
+        options.rows = height > options.subheight ? (height - options.subheight + step_y - 1) / step_y + 1 : 1;
+        options.schemes.push_back({ options.rows, options.cols, options.subwidth, options.subheight });
     }
-    if (rows > 1 && (height - 1) % rows)
+    else if (options.overlap >= 0)
     {
-        std::printf("One less than the height of %d is not evenly divisible by %d, Exiting...\n", height, rows);
+        std::printf("--overlap requires --tile-size, Exiting...\n");
         return 1;
     }
-    const auto subwidth = (width / cols) + (cols > 1 ? 1 : 0);
-    const auto subheight = (height / rows) + (rows > 1 ? 1 : 0);
 
     /*
-     * Verify the size of the HGT raster
+     * Verify the subdivisions, subtiles share their edges
+     *
+     * --subdivisions lists several, each tiling the same converted raster
      */
-    const auto data_size   = static_cast<decltype(hgt_size)>(pixel_count * sizeof(std::int16_t));
-    if (hgt_size != data_size)
+    else
     {
-        std::printf("Actual size %" PRId64 ", Expected %" PRId64 ", Exiting...\n", hgt_size, data_size);
-        return 1;
+        std::vector<std::pair<int, int>> divisions;
+        for (const char* division = subdivisions; division && *division; division = std::strchr(division, ','), division = division ? division + 1 : division)
+        {
+            std::pair<int, int> counts(0, 0);
+            std::sscanf(division, "%dx%d", &counts.first, &counts.second);
+            divisions.push_back(counts);
+        }
+        if (divisions.empty()) divisions.push_back(std::make_pair(options.rows, options.cols));
+        for (const auto& division : divisions)
+        {
+            const auto rows = division.first;
+            const auto cols = division.second;
+            if (cols < 1 || rows < 1)
+            {
+                std::printf("Both row and column must be greater than or equal to 1, Exiting...\n");
+                return 1;
+            }
+            if (cols > 1 && (width - 1) % cols)
+            {
+                std::printf("One less than the width of %d is not evenly divisible by %d, Exiting...\n", width, cols);
+                return 1;
+            }
+            if (rows > 1 && (height - 1) % rows)
+            {
+                std::printf("One less than the height of %d is not evenly divisible by %d, Exiting...\n", height, rows);
+                return 1;
+            }
+            options.schemes.push_back({
+                rows, cols, (width / cols) + (cols > 1 ? 1 : 0), (height / rows) + (rows > 1 ? 1 : 0)
+            });
+        }
+        options.rows = options.schemes[0].rows;
+        options.cols = options.schemes[0].cols;
+        options.subwidth = options.schemes[0].subwidth;
+        options.subheight = options.schemes[0].subheight;
+        options.overlap = 1;
     }
 
     /*
-     * Extract the location of the 1 degree raster from the filename
-     */
-    int  ll[2]       = { -1, -1 };
-    char hemi[2]     = {  0,  0 };
-    char* last_slash = std::strrchr(argv[2], DIRECTORY_DELIM);
-    char* file_name  = last_slash ? last_slash + 1 : hgt_filename;
-    std::sscanf(file_name, "%c%2d%c%3d.hgt", &hemi[0], &ll[0], &hemi[1], &ll[1]);
-    std::string base_name = std::string(argv[3]) + file_name;
-    base_name.erase(base_name.find_last_of("."), std::string::npos);
-    
-    /*
-     * Verify the filename raster coordinates
+     * A cached raster is converted in a single mode
      */
-    const bool valid_hemi[2] = { hemi[0] == 'N' || hemi[0] == 'S', hemi[1] == 'W' || hemi[1] == 'E' };
-    if (!valid_hemi[0] || !valid_hemi[1])
+    if (options.modes.size() > 1 && (!options.cache.empty() || options.shm))
     {
-        std::printf("Inavlid hemisphere \"%c\" in \"%s\", Exiting...\n", valid_hemi[0] ? hemi[1] : hemi[0], file_name);
+        std::printf("--modes cannot be combined with --cache or --shm, Exiting...\n");
         return 1;
     }
-    std::printf("Bounds: (%d%c, %d%c) to (%d%c, %d%c)\n",
-        ll[0], hemi[0], ll[1], hemi[1], ll[0] + 1, hemi[0], ll[1] + 1, hemi[1]
-    );
 
     /*
-     * Extract the raster into memory
+     * XYZ tiles and mosaics are written in a single mode
      */
-    std::vector<std::uint8_t> raster(data_size);
-    const auto read_size = std::fread(raster.data(), data_size, 1, hgt_file.get());
-    if (read_size != 1)
+    if (options.modes.size() > 1 && (options.zoom_min >= 0 || options.mosaic_width > 0))
     {
-        std::printf("Read size %" PRId64 ", Expected 1, Exiting...\n", read_size);
+        std::printf("--modes cannot be combined with --xyz or --mosaic, Exiting...\n");
         return 1;
     }
-    
+
     /*
-     * Swap the byte order from Big to Little Endian
-     * if the platform is Little Endian
+     * Derived products are only tiled from the source, their overviews would
+     * need reducing from products of their own
      */
-    if (is_little_endian())
+    const bool derived_products = std::any_of(options.modes.begin(), options.modes.end(),
+        [](const OutputMode& mode) { return mode.product != Product::Elevation; }
+    );
+    if (derived_products && (options.levels > 0 || options.zoom_min >= 0 || options.mosaic_width > 0 ||
+                             !options.cache.empty() || options.shm))
     {
-        std::uint8_t swp = 0;
-        for (auto i = 0; i < data_size; i += sizeof(std::int16_t))
-        {
-            swp = raster[i];
-            raster[i] = raster[i+1];
-            raster[i+1] = swp;
-        }
+        std::printf("Derived products cannot be combined with --levels, --xyz, --mosaic, --cache or --shm, Exiting...\n");
+        return 1;
     }
 
     /*
-     * Convert the raster to unsigned 16 bit and
-     * accumulate the range of the raster
+     * Relief colors heights through the table of a ramp
      */
-    int minimum = 32768;
-    int maximum = -32768;
-    int invalid = 0;
-
-    std::int32_t temp;
-    std::int16_t* svalue = nullptr;
-    for (auto i = 0; i < data_size; i += sizeof(std::int16_t))
+    if (!options.relief && std::any_of(options.modes.begin(), options.modes.end(),
+        [](const OutputMode& mode) { return mode.product == Product::Relief; }))
     {
-        svalue = reinterpret_cast<std::int16_t*>(raster.data() + i);
-        temp = static_cast<std::int32_t>(*svalue);
-        if (temp < minimum)
-        {
-            if (temp != -32768) minimum = temp;
-            else invalid++;
-        } 
-        else if (temp > maximum)
-        {
-            maximum = temp;
-        }
+        std::printf("relief requires --ramp, Exiting...\n");
+        return 1;
     }
-    std::printf("Range: [%d, %d] meters\nMissing: %d pixels\n", minimum, maximum, invalid);
 
     /*
-     *
+     * Contours are traced from the signed heights, which cached rasters and the resampled outputs skip
      */
-    double toscale = 0.0;
-    const double minf = static_cast<double>(minimum);
-    const double deltaf = static_cast<double>(maximum) - minf;
+    if (options.contours > 0 && (options.zoom_min >= 0 || options.mosaic_width > 0 || !options.cache.empty() || options.shm))
+    {
+        std::printf("--contours cannot be combined with --xyz, --mosaic, --cache or --shm, Exiting...\n");
+        return 1;
+    }
 
     /*
-     * Absolute Mode
+     * Meshes are built from the signed heights of every subtile, which a right-triangulated
+     * network only splits evenly in squares of 2^k + 1 samples
      */
-    if (argv[1][0] == 'a')
+    if (options.mesh && (options.zoom_min >= 0 || options.mosaic_width > 0 || !options.cache.empty() || options.shm))
     {
-        std::uint16_t* uvalue = nullptr;
-        for (auto i = 0; i < data_size; i += sizeof(std::int16_t))
+        std::printf("--mesh cannot be combined with --xyz, --mosaic, --cache or --shm, Exiting...\n");
+        return 1;
+    }
+    for (const auto& scheme : options.schemes)
+    {
+        const auto tile_size = scheme.subwidth - 1;
+        if (options.mesh && (scheme.subwidth != scheme.subheight || tile_size < 1 || (tile_size & (tile_size - 1)) || tile_size > 32768))
         {
-            svalue = reinterpret_cast<std::int16_t*>(raster.data() + i);
-            uvalue = reinterpret_cast<std::uint16_t*>(raster.data() + i);
-            *uvalue = *svalue == -32768 ? 0xFFFF : static_cast<std::uint16_t>(static_cast<double>(*svalue) + 32767.0);
+            std::printf("--mesh requires square subtiles of 2^k + 1 samples, not %d x %d, Exiting...\n", scheme.subwidth, scheme.subheight);
+            return 1;
         }
     }
 
     /*
-     * Relative Mode, By default('r')
+     * Resampling is of whole sources onto the subtiles, XYZ tiles and mosaics resample on their own
      */
-    else
+    if (options.resize && (options.roi || options.zoom_min >= 0 || options.mosaic_width > 0))
     {
-        /*
-         * Scale the raster to the range such that the minimum height
-         * encodes to 0 and the maximum height encodes to 65534
-         */
-        svalue = nullptr;
-        std::uint16_t* uvalue = nullptr;
-        for (auto i = 0; i < data_size; i += sizeof(std::int16_t))
-        {
-            svalue = reinterpret_cast<std::int16_t*>(raster.data() + i);
-            uvalue = reinterpret_cast<std::uint16_t*>(raster.data() + i);
-            toscale = static_cast<double>(*svalue);
-            *uvalue = *svalue == -32768 ? 0xFFFF : static_cast<std::uint16_t>((toscale - minf) * 65534.0 / deltaf);
-        }
+        std::printf("--resize cannot be combined with --bbox, --tiles, --xyz or --mosaic, Exiting...\n");
+        return 1;
     }
 
     /*
-     * Swap the byte order from Little to Big Endian
-     * if the platform is Little Endian
+     * Overviews are reduced from the whole source, a region is never whole
      */
-    if (is_little_endian())
+    if (options.roi && options.levels > 0)
     {
-        std::uint8_t swp = 0;
-        for (auto i = 0; i < data_size; i += sizeof(std::int16_t))
+        std::printf("--levels cannot be combined with --bbox or --tiles, Exiting...\n");
+        return 1;
+    }
+
+    /*
+     * Verify every overview level halves the subtiles evenly
+     */
+    for (const auto& scheme : options.schemes)
+    {
+        if (options.levels > 0 &&
+            (options.levels > 15 ||
+             (scheme.subwidth - 1) % (1 << options.levels) ||
+             (scheme.subheight - 1) % (1 << options.levels)))
         {
-            swp = raster[i];
-            raster[i] = raster[i+1];
-            raster[i+1] = swp;
+            std::printf("Subtiles of %d x %d cannot be halved %d times, Exiting...\n",
+                scheme.subwidth, scheme.subheight, options.levels
+            );
+            return 1;
         }
     }
 
     /*
-     * Calculate the physical dimensions of each subraster in radians
+     * Expand the HGT source(s)
      */
-    const double upx = deg_to_rad(1.0 / static_cast<double>(subwidth - 1));
-    const double upy = deg_to_rad(1.0 / static_cast<double>(subheight - 1));
+    std::vector<std::string> sources;
+    if (!list_sources(args[2], sources))
+    {
+        std::printf("Could not list sources \"%s\", Exiting...\n", args[2]);
+        return 1;
+    }
+    if (sources.empty())
+    {
+        std::printf("No sources match \"%s\", Exiting...\n", args[2]);
+        return 1;
+    }
 
     /*
-     * Write the PNG to a data buffer
+     * Convert every source through one pool
+     *
+     * A reader thread loads the sources in order, up to 'prefetch' ahead of those
+     * being encoded, while the workers encode the subtiles of the loaded sources.
+     * With no prefetch a source is only read once the previous one is finished.
      */
-    std::vector<std::uint8_t> png_data;
-    std::vector<std::uint8_t*> png_rows(subheight);
-    size_t total_png_size = 0;
-
-    int row_offset = 0;
-    int col_offset = 0;
-    for (auto row_index = 0; row_index < rows; row_index++)
+    const auto start = std::chrono::steady_clock::now();
     {
-        for (auto col_index = 0; col_index < cols; col_index++)
+        ThreadPool pool(options.threads);
+        BufferPool buffers((options.threads + options.prefetch) * static_cast<unsigned>(options.modes.size() + (derived_products ? 1 : 0)));
+        run.pool = &pool;
+        run.buffers = &buffers;
+        if (options.zoom_min >= 0) run_xyz(sources, run);
+        else if (options.mosaic_width > 0) run_mosaic(sources, run);
+        else
         {
-            /*
-             * Setup the PNG info
-             */
-            png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
-            png_infop   info = png_create_info_struct(png);
-            png_set_IHDR(png, info,
-                static_cast<png_uint_32>(subwidth),
-                static_cast<png_uint_32>(subheight),
-                sizeof(std::uint16_t) * 8,
-                PNG_COLOR_TYPE_GRAY,
-                PNG_INTERLACE_NONE,
-                PNG_COMPRESSION_TYPE_DEFAULT,
-                PNG_FILTER_TYPE_DEFAULT
-            );
-
-            /*
-             * Set the 'sCAL' (Physical Scale)
-             * 
-             * The dimensions of each pixel in radians
-             */
-            png_set_sCAL(png, info, 2, upx, upy);
-
-            /*
-             * Set the 'pCAL' (Pixel Calibration)
-             * 
-             * The 1st order function mapping the encoded PNG values to the physical values
-             */
-            auto decription = std::string("SRTM-HGT");
-            auto units = std::string("m");
-            auto p0 = std::to_string(minf);
-            auto p1 = std::to_string(deltaf);
-            png_charp params[2] = { &p0.at(0), &p1.at(0)};
-            png_set_pCAL(png, info, &decription.at(0), -32767, 32767, 0, 2, &units.at(0), params);
-
-            /*
-             * Setup a vector of pointers to the beginning of each row
-             */
-            for (auto row_abs = row_offset; row_abs < (row_offset + subheight); row_abs++)
-            {
-                png_rows[row_abs - row_offset] =
-                    raster.data() +
-                    row_abs * width * sizeof(std::uint16_t) +
-                    (col_offset - 1) * sizeof(std::uint16_t);
-            }
-                
-
-            /*
-             * Write the PNG to a buffer
-             */
-            png_set_rows(png, info, png_rows.data());
-            png_set_write_fn(png, &(png_data), libpng_write_stdvector, NULL);
-            png_write_png(png, info, PNG_TRANSFORM_IDENTITY, NULL);
-            png_destroy_write_struct(&png, &info);
-            const auto png_size = png_data.size();
-
-            /*
-             * Write the PNG buffer out to file
-             */
-            std::string subname =
-                base_name + "." +
-                std::to_string(row_offset) + "." + std::to_string(col_offset) + ".png";
-            CFile png_file = CFile(std::fopen(subname.c_str(), "wb"), [](FILE* f)->void { std::fclose(f); });
-            if (!hgt_file.get())
-            {
-                std::printf("Could not open file \"%s\", Exiting...\n", subname.c_str());
-                return 1;
-            }
-            const auto write_size = std::fwrite(png_data.data(), png_data.size(), 1, png_file.get());
-            png_data.clear();
-            
-            /*
-             * Verify the file write
-             */
-            if (write_size != 1)
-            {
-                std::printf("Write size %" PRId64 ", Expected 1, Exiting...\n", write_size);
-                return 1;
-            }
-
-            total_png_size += png_size;
-            col_offset += (subheight - 1);      
+            if (options.global_range) gather_stats(sources, run);
+            std::thread reader([&run, &sources]() {
+                for (const auto& source : sources)
+                {
+                    {
+                        std::unique_lock<std::mutex> guard(run.lock);
+                        run.read_ahead.wait(guard, [&run]() { return run.waiting < run.options.prefetch || run.in_flight == 0; });
+                        run.waiting++;
+                        run.in_flight++;
+                    }
+                    convert_source(source, run);
+                }
+            });
+            reader.join();
+            pool.wait();
         }
-        col_offset = 0;
-        row_offset += (subwidth - 1);
     }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
 
     /*
-     * Show some statistics
+     * Show the aggregate statistics of a batch
      */
-    std::printf("Output: Compression: %.2lf%% of original size\n",
-        static_cast<double>(total_png_size) / static_cast<double>(data_size) * 100.0
-    );
+    if (sources.size() > 1)
+    {
+        std::printf("Batch: %zu sources, %d converted, %d unchanged, %d outside the region, %zu failed\n",
+            sources.size(), run.converted.load(), run.skipped.load(), run.empty.load(), run.failures.size()
+        );
+        std::printf("Throughput: %.2lf s, %.2lf sources/s, %.2lf subtiles/s, %.2lf MB/s read, %.2lf MB written\n",
+            seconds,
+            static_cast<double>(sources.size()) / seconds,
+            static_cast<double>(run.subtiles.load()) / seconds,
+            static_cast<double>(run.source_bytes.load()) / seconds / 1.0e6,
+            static_cast<double>(run.png_bytes.load()) / 1.0e6
+        );
+        for (const auto& failure : run.failures) std::printf("Failed: %s\n", failure.c_str());
+    }
     
-    return 0;
-}
\ No newline at end of file
+    return run.failures.empty() ? 0 : 1;
+}